@@ -136,7 +136,10 @@ class Posthog {
 
   Future<bool> isFeatureEnabled(String key) => _posthog.isFeatureEnabled(key);
 
-  Future<void> reloadFeatureFlags() => _posthog.reloadFeatureFlags();
+  /// [flagKeys] is Linux only: fetches just those flags, the others keep
+  /// their current values
+  Future<void> reloadFeatureFlags({List<String>? flagKeys}) =>
+      _posthog.reloadFeatureFlags(flagKeys: flagKeys);
 
   Future<void> group({
     required String groupType,
@@ -155,6 +158,14 @@ class Posthog {
   Future<Object?> getFeatureFlagPayload(String key) =>
       _posthog.getFeatureFlagPayload(key: key);
 
+  /// Linux only: every flag and payload in a single call, as
+  /// `{'featureFlags': {key: bool or variant}, 'featureFlagPayloads': {key: payload}}`.
+  /// Use this instead of one [getFeatureFlag] call per flag when a screen
+  /// depends on many flags. Does not send `$feature_flag_called` events.
+  /// Returns an empty map on other platforms.
+  Future<Map<String, Object?>> getAllFeatureFlagsAndPayloads() =>
+      _posthog.getAllFeatureFlagsAndPayloads();
+
   Future<void> flush() => _posthog.flush();
 
   /// Captures exceptions with optional custom properties
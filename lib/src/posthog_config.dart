@@ -2,6 +2,11 @@ enum PostHogPersonProfiles { never, always, identifiedOnly }
 
 enum PostHogDataMode { wifi, cellular, any }
 
+/// Receives the feature flags that changed in a reload, keyed by flag with
+/// their new value (`bool` or variant `String`), or `null` for removed flags.
+typedef OnFeatureFlagsCallback = void Function(
+    Map<String, Object?> changedFlags);
+
 class PostHogConfig {
   final String apiKey;
   var host = 'https://us.i.posthog.com';
@@ -29,6 +34,46 @@ class PostHogConfig {
   /// iOS only
   var dataMode = PostHogDataMode.any;
 
+  /// Linux only
+  /// Feature flags secure API key (`phs_...`, from the project's feature flag
+  /// settings) used to download flag definitions so flags can be evaluated
+  /// on-device. Flags that can't be decided locally still use the remote result.
+  ///
+  /// The key ships inside the app and can be extracted by anyone who has it.
+  /// It only grants read access to flag definitions, which include every
+  /// flag's targeting rules. Never use a personal API key (`phx_...`) here: it
+  /// would expose your whole PostHog account, so it is rejected.
+  /// Defaults to null (remote evaluation only).
+  String? featureFlagsSecureApiKey;
+
+  /// Linux only
+  /// How often feature flags are refreshed in the background. Cached values
+  /// keep being served while a refresh is in flight; refreshes are jittered and
+  /// back off while requests are failing.
+  /// Defaults to null (flags only reload at startup and on [Posthog.reloadFeatureFlags]).
+  Duration? featureFlagRefreshInterval;
+
+  /// Linux only
+  /// Called after feature flags are reloaded, with only the flags whose value
+  /// changed. Lets the app react to (or cache) flags without polling
+  /// [Posthog.getFeatureFlag].
+  /// Defaults to null.
+  OnFeatureFlagsCallback? onFeatureFlags;
+
+  /// Linux only
+  /// Feature flag values served until flags have been fetched for the first
+  /// time (e.g. on a fresh install), as
+  /// `{'featureFlags': {key: bool or variant}, 'featureFlagPayloads': {key: payload}}`.
+  /// Ignored when cached flags exist; the first successful reload replaces them.
+  /// Defaults to null.
+  Map<String, Object>? bootstrapFeatureFlags;
+
+  /// Linux only
+  /// Path to a JSON file in the same shape as [bootstrapFeatureFlags], e.g. one
+  /// shipped with the app. Values in [bootstrapFeatureFlags] take precedence.
+  /// Defaults to null.
+  String? bootstrapFeatureFlagsPath;
+
   /// Enable Surveys
   ///
   /// **Notes:**
@@ -57,7 +102,7 @@ class PostHogConfig {
   final errorTrackingConfig = PostHogErrorTrackingConfig();
 
   // TODO: missing getAnonymousId, propertiesSanitizer, captureDeepLinks
-  // onFeatureFlags, integrations
+  // integrations
 
   PostHogConfig(this.apiKey);
 
@@ -79,6 +124,14 @@ class PostHogConfig {
       'sessionReplay': sessionReplay,
       'autocapture': autocapture,
       'dataMode': dataMode.name,
+      if (featureFlagsSecureApiKey != null)
+        'featureFlagsSecureApiKey': featureFlagsSecureApiKey,
+      if (featureFlagRefreshInterval != null)
+        'featureFlagRefreshInterval': featureFlagRefreshInterval!.inSeconds,
+      'notifyFeatureFlagChanges': onFeatureFlags != null,
+      if (bootstrapFeatureFlags != null) 'bootstrap': bootstrapFeatureFlags,
+      if (bootstrapFeatureFlagsPath != null)
+        'bootstrapPath': bootstrapFeatureFlagsPath,
       'sessionReplayConfig': sessionReplayConfig.toMap(),
       'errorTrackingConfig': errorTrackingConfig.toMap(),
     };
@@ -132,6 +185,13 @@ class PostHogSessionReplayConfig {
   /// Defaults to 0 (no resizing).
   var maxImageDimension = 0;
 
+  /// Linux only
+  /// Maximum time between full screenshots. In between, only the parts of the
+  /// screen that changed are uploaded, which keeps mostly static UIs cheap.
+  /// Set to [Duration.zero] to always send full screenshots.
+  /// Defaults to 30 seconds.
+  var keyframeInterval = const Duration(seconds: 30);
+
   /// Enable pausing session replay recording after a period of user inactivity.
   /// When enabled, recording will pause after [idleTimeout] and resume on any user interaction.
   /// This is useful for apps with idle animations or background updates that shouldn't be recorded.
@@ -160,6 +220,7 @@ class PostHogSessionReplayConfig {
       'batchSize': batchSize,
       'batchIntervalMs': batchInterval.inMilliseconds,
       'maxImageDimension': maxImageDimension,
+      'keyframeIntervalMs': keyframeInterval.inMilliseconds,
       'pauseOnIdle': pauseOnIdle,
       'idleTimeoutMs': idleTimeout.inMilliseconds,
       'sessionTimeoutMs': sessionTimeout.inMilliseconds,
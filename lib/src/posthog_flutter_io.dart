@@ -38,6 +38,12 @@ class PosthogFlutterIO extends PosthogFlutterPlatformInterface {
       case 'hideSurveys':
         await cleanupSurveys();
         return null;
+      case 'onFeatureFlags':
+        final arguments = Map<String, Object?>.from(call.arguments as Map);
+        final changedFlags =
+            Map<String, Object?>.from(arguments['changedFlags'] as Map);
+        _config?.onFeatureFlags?.call(changedFlags);
+        return null;
       default:
         printIfDebug(
             '[PostHog] ${call.method} not implemented in PosthogFlutterPlatformInterface');
@@ -326,13 +332,14 @@ class PosthogFlutterIO extends PosthogFlutterPlatformInterface {
   }
 
   @override
-  Future<void> reloadFeatureFlags() async {
+  Future<void> reloadFeatureFlags({List<String>? flagKeys}) async {
     if (!isSupportedPlatform()) {
       return;
     }
 
     try {
-      await _methodChannel.invokeMethod('reloadFeatureFlags');
+      await _methodChannel.invokeMethod('reloadFeatureFlags',
+          flagKeys != null ? {'flagKeys': flagKeys} : null);
     } on PlatformException catch (exception) {
       printIfDebug('Exeption on reloadFeatureFlags: $exception');
     }
@@ -400,6 +407,25 @@ class PosthogFlutterIO extends PosthogFlutterPlatformInterface {
     }
   }
 
+  @override
+  Future<Map<String, Object?>> getAllFeatureFlagsAndPayloads() async {
+    if (!isSupportedPlatform()) {
+      return {};
+    }
+
+    try {
+      final result = await _methodChannel
+          .invokeMapMethod<String, Object?>('getAllFeatureFlagsAndPayloads');
+      return result ?? {};
+    } on PlatformException catch (exception) {
+      printIfDebug('Exeption on getAllFeatureFlagsAndPayloads: $exception');
+      return {};
+    } on MissingPluginException {
+      // Only the Linux plugin implements this so far
+      return {};
+    }
+  }
+
   @override
   Future<void> register(String key, Object value) async {
     if (!isSupportedPlatform()) {
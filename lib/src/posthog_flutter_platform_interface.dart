@@ -96,7 +96,7 @@ abstract class PosthogFlutterPlatformInterface extends PlatformInterface {
     throw UnimplementedError('isFeatureEnabled() has not been implemented.');
   }
 
-  Future<void> reloadFeatureFlags() {
+  Future<void> reloadFeatureFlags({List<String>? flagKeys}) {
     throw UnimplementedError('reloadFeatureFlags() has not been implemented.');
   }
 
@@ -125,6 +125,11 @@ abstract class PosthogFlutterPlatformInterface extends PlatformInterface {
         'getFeatureFlagPayload() has not been implemented.');
   }
 
+  Future<Map<String, Object?>> getAllFeatureFlagsAndPayloads() {
+    throw UnimplementedError(
+        'getAllFeatureFlagsAndPayloads() has not been implemented.');
+  }
+
   Future<void> flush() {
     throw UnimplementedError('flush() has not been implemented.');
   }
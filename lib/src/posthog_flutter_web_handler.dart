@@ -204,6 +204,8 @@ Future<dynamic> handleWebMethodCall(MethodCall call) async {
       // not supported on Web
       // Flutter Web uses the JS SDK for Session replay
       return false;
+    case 'supportsRawSnapshot':
+      return false;
     case 'openUrl':
       // not supported on Web
       break;
@@ -164,6 +164,19 @@ class PostHogWidgetState extends State<PostHogWidget> {
           screen: Posthog().currentScreen);
     }
 
+    if (imageInfo.isRaw) {
+      await _nativeCommunicator?.sendRawSnapshot(imageInfo.imageBytes,
+          imageWidth: imageInfo.imageWidth,
+          imageHeight: imageInfo.imageHeight,
+          stride: imageInfo.imageWidth * 4,
+          id: imageInfo.id,
+          x: imageInfo.x,
+          y: imageInfo.y,
+          width: imageInfo.width,
+          height: imageInfo.height);
+      return;
+    }
+
     await _nativeCommunicator?.sendFullSnapshot(imageInfo.imageBytes,
         id: imageInfo.id,
         x: imageInfo.x,
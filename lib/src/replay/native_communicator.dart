@@ -4,6 +4,9 @@ import 'package:posthog_flutter/src/util/logging.dart';
 class NativeCommunicator {
   static const MethodChannel _channel = MethodChannel('posthog_flutter');
 
+  // Resolved once per isolate; platforms without the method report false
+  static Future<bool>? _supportsRawSnapshot;
+
   Future<void> sendFullSnapshot(Uint8List imageBytes,
       {required int id, required int x, required int y, required int width, required int height}) async {
     try {
@@ -20,6 +23,46 @@ class NativeCommunicator {
     }
   }
 
+  /// Sends unencoded RGBA pixels ([imageWidth] x [imageHeight], rows
+  /// [stride] bytes apart), letting the native side skip the PNG round trip.
+  /// Only call this when [supportsRawSnapshot] returned true.
+  Future<void> sendRawSnapshot(Uint8List rgbaBytes,
+      {required int imageWidth,
+      required int imageHeight,
+      required int stride,
+      required int id,
+      required int x,
+      required int y,
+      required int width,
+      required int height}) async {
+    try {
+      await _channel.invokeMethod('sendRawSnapshot', {
+        'imageBytes': rgbaBytes,
+        'imageWidth': imageWidth,
+        'imageHeight': imageHeight,
+        'stride': stride,
+        'id': id,
+        'x': x,
+        'y': y,
+        'width': width,
+        'height': height,
+      });
+    } catch (e) {
+      printIfDebug('Error sending raw snapshot to native: $e');
+    }
+  }
+
+  Future<bool> supportsRawSnapshot() {
+    return _supportsRawSnapshot ??= () async {
+      try {
+        return await _channel.invokeMethod<bool>('supportsRawSnapshot') ??
+            false;
+      } catch (e) {
+        return false;
+      }
+    }();
+  }
+
   Future<void> sendMetaEvent(
       {required int width,
       required int height,
@@ -24,8 +24,16 @@ class ImageInfo {
   final bool shouldSendMetaEvent;
   final Uint8List imageBytes;
 
+  /// Whether [imageBytes] holds unencoded RGBA pixels instead of a PNG
+  final bool isRaw;
+
+  /// Pixel dimensions of [imageBytes]; only set when [isRaw]
+  final int imageWidth;
+  final int imageHeight;
+
   ImageInfo(this.id, this.x, this.y, this.width, this.height,
-      this.shouldSendMetaEvent, this.imageBytes);
+      this.shouldSendMetaEvent, this.imageBytes,
+      {this.isRaw = false, this.imageWidth = 0, this.imageHeight = 0});
 }
 
 class ViewTreeSnapshotStatus {
@@ -54,10 +62,10 @@ class ScreenshotCapturer {
     return min(width / srcWidth, height / srcHeight);
   }
 
-  Future<Uint8List?> _getImageBytes(ui.Image img) async {
+  Future<Uint8List?> _getImageBytes(ui.Image img, {bool raw = false}) async {
     try {
-      final ByteData? byteData =
-          await img.toByteData(format: ui.ImageByteFormat.png);
+      final ByteData? byteData = await img.toByteData(
+          format: raw ? ui.ImageByteFormat.rawRgba : ui.ImageByteFormat.png);
       if (byteData == null || byteData.lengthInBytes == 0) {
         printIfDebug('Error: Failed to convert image to byte data.');
         return null;
@@ -69,6 +77,26 @@ class ScreenshotCapturer {
     }
   }
 
+  // Raw frames are several MB, so compare them a word at a time
+  bool _sameRawBytes(Uint8List a, Uint8List? b) {
+    if (b == null || a.lengthInBytes != b.lengthInBytes) {
+      return false;
+    }
+    if (a.lengthInBytes % 8 != 0 ||
+        a.offsetInBytes % 8 != 0 ||
+        b.offsetInBytes % 8 != 0) {
+      return const PHListEquality().equals(a, b);
+    }
+    final wordsA = a.buffer.asUint64List(a.offsetInBytes, a.lengthInBytes ~/ 8);
+    final wordsB = b.buffer.asUint64List(b.offsetInBytes, b.lengthInBytes ~/ 8);
+    for (var i = 0; i < wordsA.length; i++) {
+      if (wordsA[i] != wordsB[i]) {
+        return false;
+      }
+    }
+    return true;
+  }
+
   Future<ImageInfo?> captureScreenshot() {
     final context = PostHogMaskController.instance.containerKey.currentContext;
     if (context == null) {
@@ -119,6 +147,8 @@ class ScreenshotCapturer {
       Future(() async {
         final isSessionReplayActive =
             await _nativeCommunicator.isSessionReplayActive();
+        // Linux encodes raw pixels directly, skipping PNG encode + decode
+        final useRaw = await _nativeCommunicator.supportsRawSnapshot();
 
         // wait the UI to settle
         await SchedulerBinding.instance.endOfFrame;
@@ -136,8 +166,9 @@ class ScreenshotCapturer {
         // using png because its compressed, the native SDKs will decompress it
         // and transform to webp or jpeg if needed
         // https://github.com/brendan-duncan/image does not have webp encoding
-        Uint8List? pngBytes = await _getImageBytes(image);
-        if (pngBytes == null || pngBytes.isEmpty) {
+        // When the platform supports it, raw RGBA goes straight to the encoder
+        Uint8List? frameBytes = await _getImageBytes(image, raw: useRaw);
+        if (frameBytes == null || frameBytes.isEmpty) {
           printIfDebug(
               'Error: Failed to convert image byte data to Uint8List.');
           recorder.endRecording().dispose();
@@ -146,7 +177,10 @@ class ScreenshotCapturer {
           return;
         }
 
-        if (const PHListEquality().equals(pngBytes, statusView.imageBytes)) {
+        final sameAsLast = useRaw
+            ? _sameRawBytes(frameBytes, statusView.imageBytes)
+            : const PHListEquality().equals(frameBytes, statusView.imageBytes);
+        if (sameAsLast) {
           printIfDebug(
               'Debug: Snapshot is the same as the last one, nothing changed, do nothing.');
           recorder.endRecording().dispose();
@@ -155,7 +189,7 @@ class ScreenshotCapturer {
           return;
         }
 
-        statusView.imageBytes = pngBytes;
+        statusView.imageBytes = frameBytes;
 
         try {
           canvas.drawImage(image, Offset.zero, Paint());
@@ -183,8 +217,9 @@ class ScreenshotCapturer {
             }
 
             try {
-              final maskedImagePngBytes = await _getImageBytes(finalImage);
-              if (maskedImagePngBytes == null || maskedImagePngBytes.isEmpty) {
+              final maskedImageBytes =
+                  await _getImageBytes(finalImage, raw: useRaw);
+              if (maskedImageBytes == null || maskedImageBytes.isEmpty) {
                 finalImage.dispose();
                 picture.dispose();
                 completer.complete(null);
@@ -198,7 +233,10 @@ class ScreenshotCapturer {
                 srcWidth.toInt(),
                 srcHeight.toInt(),
                 shouldSendMetaEvent,
-                maskedImagePngBytes,
+                maskedImageBytes,
+                isRaw: useRaw,
+                imageWidth: finalImage.width,
+                imageHeight: finalImage.height,
               );
               _snapshotManager.updateStatus(renderObject,
                   shouldSendMetaEvent: shouldSendMetaEvent);
@@ -230,8 +268,8 @@ class ScreenshotCapturer {
             }
 
             try {
-              final pngBytes = await _getImageBytes(finalImage);
-              if (pngBytes == null || pngBytes.isEmpty) {
+              final imageBytes = await _getImageBytes(finalImage, raw: useRaw);
+              if (imageBytes == null || imageBytes.isEmpty) {
                 finalImage.dispose();
                 picture.dispose();
                 completer.complete(null);
@@ -245,7 +283,10 @@ class ScreenshotCapturer {
                 srcWidth.toInt(),
                 srcHeight.toInt(),
                 shouldSendMetaEvent,
-                pngBytes,
+                imageBytes,
+                isRaw: useRaw,
+                imageWidth: finalImage.width,
+                imageHeight: finalImage.height,
               );
               _snapshotManager.updateStatus(renderObject,
                   shouldSendMetaEvent: shouldSendMetaEvent);
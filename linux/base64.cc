@@ -0,0 +1,194 @@
+#include "base64.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BASE64_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define BASE64_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace posthog {
+
+namespace {
+
+const char kAlphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Vector kernels encode whole blocks and return how many input bytes they
+// consumed (always a multiple of 3); the scalar loop finishes the rest.
+using BlockEncoder = size_t (*)(const uint8_t* data, size_t size, char* out);
+
+void EncodeScalar(const uint8_t* data, size_t size, char* out) {
+  size_t i = 0;
+  for (; i + 3 <= size; i += 3, out += 4) {
+    uint32_t b = (static_cast<uint32_t>(data[i]) << 16) | (data[i + 1] << 8) | data[i + 2];
+    out[0] = kAlphabet[b >> 18];
+    out[1] = kAlphabet[(b >> 12) & 0x3F];
+    out[2] = kAlphabet[(b >> 6) & 0x3F];
+    out[3] = kAlphabet[b & 0x3F];
+  }
+
+  size_t remaining = size - i;
+  if (remaining > 0) {
+    uint32_t b = static_cast<uint32_t>(data[i]) << 16;
+    if (remaining > 1) {
+      b |= data[i + 1] << 8;
+    }
+    out[0] = kAlphabet[b >> 18];
+    out[1] = kAlphabet[(b >> 12) & 0x3F];
+    out[2] = remaining > 1 ? kAlphabet[(b >> 6) & 0x3F] : '=';
+    out[3] = '=';
+  }
+}
+
+#if defined(BASE64_X86)
+
+// 12 input bytes -> 16 characters (Muła's multiply-shift unpack). Each 32-bit
+// lane holds one 3-byte group; the multiplies move its four 6-bit fields into
+// separate bytes, and a 16-entry shuffle table supplies the per-range offset
+// that turns a 6-bit index into its ASCII character.
+__attribute__((target("ssse3")))
+size_t EncodeSsse3(const uint8_t* data, size_t size, char* out) {
+  const __m128i shuffle = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+  const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                        '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+  size_t i = 0;
+  // Each step loads 16 bytes but only consumes 12
+  for (; i + 16 <= size; i += 12, out += 16) {
+    __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    in = _mm_shuffle_epi8(in, shuffle);
+    __m128i hi = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)),
+                                 _mm_set1_epi32(0x04000040));
+    __m128i lo = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)),
+                                 _mm_set1_epi32(0x01000010));
+    __m128i indices = _mm_or_si128(hi, lo);
+
+    // 0..25 -> 13, 26..51 -> 0, 52..63 -> 1..12: a slot in the offset table
+    __m128i slot = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    __m128i upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    slot = _mm_or_si128(slot, _mm_and_si128(upper, _mm_set1_epi8(13)));
+    __m128i chars = _mm_add_epi8(indices, _mm_shuffle_epi8(offsets, slot));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), chars);
+  }
+  return i;
+}
+
+// Same scheme as the SSSE3 kernel, 24 input bytes -> 32 characters. The load
+// starts 4 bytes before the block so each 128-bit lane finds its 12 bytes
+// without a cross-lane permute, which means the first block has to go
+// through the 128-bit kernel.
+__attribute__((target("avx2")))
+size_t EncodeAvx2(const uint8_t* data, size_t size, char* out) {
+  if (size < 16 + 28) {
+    return EncodeSsse3(data, size, out);
+  }
+
+  const __m256i shuffle = _mm256_setr_epi8(5, 4, 6, 5, 8, 7, 9, 8, 11, 10, 12, 11, 14, 13, 15, 14,
+                                           1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+  const __m256i offsets = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                           '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                           '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+                                           'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                           '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                           '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+  EncodeSsse3(data, 16, out);
+  size_t i = 12;
+  out += 16;
+  for (; i + 28 <= size; i += 24, out += 32) {
+    __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i - 4));
+    in = _mm256_shuffle_epi8(in, shuffle);
+    __m256i hi = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)),
+                                    _mm256_set1_epi32(0x04000040));
+    __m256i lo = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)),
+                                    _mm256_set1_epi32(0x01000010));
+    __m256i indices = _mm256_or_si256(hi, lo);
+
+    __m256i slot = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+    __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+    slot = _mm256_or_si256(slot, _mm256_and_si256(upper, _mm256_set1_epi8(13)));
+    __m256i chars = _mm256_add_epi8(indices, _mm256_shuffle_epi8(offsets, slot));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), chars);
+  }
+  return i + EncodeSsse3(data + i, size - i, out);
+}
+
+BlockEncoder SelectEncoder() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return EncodeAvx2;
+  }
+  if (__builtin_cpu_supports("ssse3")) {
+    return EncodeSsse3;
+  }
+  return nullptr;
+}
+
+#elif defined(BASE64_NEON)
+
+// 48 input bytes -> 64 characters. vld3 de-interleaves the byte triples, so
+// the four 6-bit fields come out with plain shifts, and a 64-byte table
+// lookup maps them straight to ASCII.
+size_t EncodeNeon(const uint8_t* data, size_t size, char* out) {
+  const uint8_t* alphabet = reinterpret_cast<const uint8_t*>(kAlphabet);
+  uint8x16x4_t table;
+  table.val[0] = vld1q_u8(alphabet);
+  table.val[1] = vld1q_u8(alphabet + 16);
+  table.val[2] = vld1q_u8(alphabet + 32);
+  table.val[3] = vld1q_u8(alphabet + 48);
+  const uint8x16_t mask = vdupq_n_u8(0x3F);
+
+  size_t i = 0;
+  for (; i + 48 <= size; i += 48, out += 64) {
+    uint8x16x3_t in = vld3q_u8(data + i);
+    uint8x16x4_t indices;
+    indices.val[0] = vshrq_n_u8(in.val[0], 2);
+    indices.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[0], 4), vshrq_n_u8(in.val[1], 4)), mask);
+    indices.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[1], 2), vshrq_n_u8(in.val[2], 6)), mask);
+    indices.val[3] = vandq_u8(in.val[2], mask);
+
+    uint8x16x4_t chars;
+    chars.val[0] = vqtbl4q_u8(table, indices.val[0]);
+    chars.val[1] = vqtbl4q_u8(table, indices.val[1]);
+    chars.val[2] = vqtbl4q_u8(table, indices.val[2]);
+    chars.val[3] = vqtbl4q_u8(table, indices.val[3]);
+    vst4q_u8(reinterpret_cast<uint8_t*>(out), chars);
+  }
+  return i;
+}
+
+BlockEncoder SelectEncoder() {
+  // Advanced SIMD is mandatory on AArch64
+  return EncodeNeon;
+}
+
+#else
+
+BlockEncoder SelectEncoder() {
+  return nullptr;
+}
+
+#endif
+
+}  // namespace
+
+void Base64Encode(const uint8_t* data, size_t size, char* out) {
+  static const BlockEncoder encoder = SelectEncoder();
+  size_t done = encoder ? encoder(data, size, out) : 0;
+  EncodeScalar(data + done, size - done, out + done / 3 * 4);
+}
+
+void Base64Append(const uint8_t* data, size_t size, std::string& out) {
+  size_t offset = out.size();
+  out.resize(offset + Base64EncodedSize(size));
+  Base64Encode(data, size, &out[offset]);
+}
+
+std::string Base64Encode(const std::vector<uint8_t>& data) {
+  std::string out;
+  Base64Append(data.data(), data.size(), out);
+  return out;
+}
+
+}  // namespace posthog
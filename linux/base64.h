@@ -0,0 +1,31 @@
+#ifndef BASE64_H_
+#define BASE64_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace posthog {
+
+// Length of the padded base64 encoding of `size` bytes
+constexpr size_t Base64EncodedSize(size_t size) {
+  return (size + 2) / 3 * 4;
+}
+
+// Encode `size` bytes as padded standard base64 into a caller-provided buffer
+// of at least Base64EncodedSize(size) bytes (no terminating NUL is written).
+// Bulk input runs through an AVX2/SSSE3 kernel on x86 (picked once at runtime
+// from the CPU's features) or NEON on AArch64, with a scalar fallback and
+// scalar handling of the final partial block.
+void Base64Encode(const uint8_t* data, size_t size, char* out);
+
+// Append the encoding of `size` bytes to `out`, growing it exactly once
+void Base64Append(const uint8_t* data, size_t size, std::string& out);
+
+// Convenience overload returning a std::string
+std::string Base64Encode(const std::vector<uint8_t>& data);
+
+}  // namespace posthog
+
+#endif  // BASE64_H_
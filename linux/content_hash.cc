@@ -0,0 +1,87 @@
+#include "content_hash.h"
+
+#include <cstring>
+
+namespace posthog {
+
+namespace {
+
+const uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+const uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+const uint64_t kPrime4 = 0x85EBCA77C2B2AE63ULL;
+const uint64_t kPrime5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t Rotl(uint64_t x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+inline uint64_t Load64(const uint8_t* p) {
+  uint64_t word;
+  memcpy(&word, p, sizeof(word));
+  return word;
+}
+
+inline uint32_t Load32(const uint8_t* p) {
+  uint32_t word;
+  memcpy(&word, p, sizeof(word));
+  return word;
+}
+
+inline uint64_t Round(uint64_t acc, uint64_t input) {
+  return Rotl(acc + input * kPrime2, 31) * kPrime1;
+}
+
+inline uint64_t Merge(uint64_t acc, uint64_t lane) {
+  return (acc ^ Round(0, lane)) * kPrime1 + kPrime4;
+}
+
+}  // namespace
+
+uint64_t ContentHash(const void* data, size_t size, uint64_t seed) {
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  const uint8_t* end = p + size;
+  uint64_t h;
+
+  if (size >= 32) {
+    // Four independent lanes keep the multiplies pipelined
+    uint64_t lane0 = seed + kPrime1 + kPrime2;
+    uint64_t lane1 = seed + kPrime2;
+    uint64_t lane2 = seed;
+    uint64_t lane3 = seed - kPrime1;
+    for (; p + 32 <= end; p += 32) {
+      lane0 = Round(lane0, Load64(p));
+      lane1 = Round(lane1, Load64(p + 8));
+      lane2 = Round(lane2, Load64(p + 16));
+      lane3 = Round(lane3, Load64(p + 24));
+    }
+    h = Rotl(lane0, 1) + Rotl(lane1, 7) + Rotl(lane2, 12) + Rotl(lane3, 18);
+    h = Merge(h, lane0);
+    h = Merge(h, lane1);
+    h = Merge(h, lane2);
+    h = Merge(h, lane3);
+  } else {
+    h = seed + kPrime5;
+  }
+
+  h += size;
+  for (; p + 8 <= end; p += 8) {
+    h = Rotl(h ^ Round(0, Load64(p)), 27) * kPrime1 + kPrime4;
+  }
+  if (p + 4 <= end) {
+    h = Rotl(h ^ (Load32(p) * kPrime1), 23) * kPrime2 + kPrime3;
+    p += 4;
+  }
+  for (; p < end; p++) {
+    h = Rotl(h ^ (*p * kPrime5), 11) * kPrime1;
+  }
+
+  h ^= h >> 33;
+  h *= kPrime2;
+  h ^= h >> 29;
+  h *= kPrime3;
+  h ^= h >> 32;
+  return h;
+}
+
+}  // namespace posthog
@@ -0,0 +1,16 @@
+#ifndef CONTENT_HASH_H_
+#define CONTENT_HASH_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace posthog {
+
+// XXH64 of `size` bytes. Fast enough to run over whole raw frames (memory
+// bandwidth bound), and well distributed, but not cryptographic. Words are
+// read in native byte order, so hashes are only comparable within a process.
+uint64_t ContentHash(const void* data, size_t size, uint64_t seed = 0);
+
+}  // namespace posthog
+
+#endif  // CONTENT_HASH_H_
@@ -1,174 +1,738 @@
 #include "feature_flags_manager.h"
-#include <sstream>
-#include <iostream>
-#include <algorithm>
+#include "task_executor.h"
+#include "posthog_logger.h"
+#include "posthog_metrics.h"
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
 
-// Simple JSON parsing helpers (for a production implementation, use a proper JSON library)
 namespace {
-  std::string ExtractJsonValue(const std::string& json, const std::string& key) {
-    std::string search_key = "\"" + key + "\"";
-    size_t pos = json.find(search_key);
-    if (pos == std::string::npos) return "";
-    
-    pos = json.find(":", pos);
-    if (pos == std::string::npos) return "";
-    pos++;
-    
-    // Skip whitespace
-    while (pos < json.length() && (json[pos] == ' ' || json[pos] == '\t')) pos++;
+  // Identifies a flags request; std::map iterates in key order, so equal
+  // requests always produce the same key
+  std::string MakeRequestKey(const std::string& distinct_id,
+                             const std::map<std::string, std::string>& properties,
+                             const std::vector<std::string>& flag_keys) {
+    std::string request_key = distinct_id;
+    for (const auto& property : properties) {
+      request_key += '\0' + property.first + '\0' + property.second;
+    }
+    for (const auto& flag_key : flag_keys) {
+      request_key += '\1' + flag_key;
+    }
+    return request_key;
+  }
+
+  // Persisted flag cache: a format tag and flag count, then per flag an enabled
+  // byte and length-prefixed key, variant and payload. Host byte order; the
+  // cache never leaves the machine. Any other format is ignored on load.
+  const uint32_t kFlagCacheFormat = 0x31464850;  // "PHF1"
+
+  // Identities whose flags are kept, in memory and in storage
+  const size_t kCachedIdentities = 16;
+
+  void AppendU32(std::string* out, uint32_t value) {
+    out->append(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+
+  void AppendString(std::string* out, const std::string& value) {
+    AppendU32(out, static_cast<uint32_t>(value.size()));
+    out->append(value);
+  }
+
+  std::string EncodeFlagCache(const FeatureFlagMap& flags) {
+    size_t size = 2 * sizeof(uint32_t);
+    for (const auto& entry : flags) {
+      size += 1 + 3 * sizeof(uint32_t) + entry.first.size() + entry.second.variant.size()
+              + entry.second.payload_json.size();
+    }
     
-    if (pos >= json.length()) return "";
+    std::string out;
+    out.reserve(size);
+    AppendU32(&out, kFlagCacheFormat);
+    AppendU32(&out, static_cast<uint32_t>(flags.size()));
+    for (const auto& entry : flags) {
+      out.push_back(entry.second.enabled ? 1 : 0);
+      AppendString(&out, entry.first);
+      AppendString(&out, entry.second.variant);
+      AppendString(&out, entry.second.payload_json);
+    }
+    return out;
+  }
+
+  bool SameFlag(const posthog::FeatureFlagValue& a, const posthog::FeatureFlagValue& b) {
+    return a.enabled == b.enabled && a.variant == b.variant && a.payload_json == b.payload_json;
+  }
+
+  // Keys whose value differs between two flag sets, including added and removed ones
+  std::vector<std::string> DiffFlags(const FeatureFlagMap& previous, const FeatureFlagMap& current) {
+    std::vector<std::string> changed_keys;
+    for (const auto& entry : current) {
+      auto it = previous.find(entry.first);
+      if (it == previous.end() || !SameFlag(it->second, entry.second)) {
+        changed_keys.push_back(entry.first);
+      }
+    }
+    for (const auto& entry : previous) {
+      if (current.count(entry.first) == 0) {
+        changed_keys.push_back(entry.first);
+      }
+    }
+    return changed_keys;
+  }
+
+  class FlagCacheReader {
+   public:
+    explicit FlagCacheReader(const std::string& data) : data_(data), pos_(0) {}
+
+    bool ReadU32(uint32_t* value) {
+      if (data_.size() - pos_ < sizeof(uint32_t)) return false;
+      memcpy(value, data_.data() + pos_, sizeof(uint32_t));
+      pos_ += sizeof(uint32_t);
+      return true;
+    }
+
+    bool ReadByte(uint8_t* value) {
+      if (pos_ >= data_.size()) return false;
+      *value = static_cast<uint8_t>(data_[pos_++]);
+      return true;
+    }
+
+    bool ReadString(std::string* value) {
+      uint32_t length;
+      if (!ReadU32(&length) || data_.size() - pos_ < length) return false;
+      value->assign(data_, pos_, length);
+      pos_ += length;
+      return true;
+    }
+
+   private:
+    const std::string& data_;
+    size_t pos_;
+  };
+
+  bool DecodeFlagCache(const std::string& data, FeatureFlagMap* flags) {
+    FlagCacheReader reader(data);
+    uint32_t format, count;
+    if (!reader.ReadU32(&format) || format != kFlagCacheFormat || !reader.ReadU32(&count)) {
+      return false;
+    }
     
-    // Extract value
-    if (json[pos] == '"') {
-      // String value
-      pos++;
-      size_t end = json.find('"', pos);
-      if (end == std::string::npos) return "";
-      return json.substr(pos, end - pos);
-    } else if (json[pos] == '{') {
-      // Object value - find matching brace
-      int depth = 1;
-      size_t end = pos + 1;
-      while (end < json.length() && depth > 0) {
-        if (json[end] == '{') depth++;
-        else if (json[end] == '}') depth--;
-        end++;
-      }
-      return json.substr(pos, end - pos);
-    } else {
-      // Number or boolean
-      size_t end = pos;
-      while (end < json.length() && json[end] != ',' && json[end] != '}' && json[end] != ']') {
-        end++;
+    flags->reserve(count);
+    for (uint32_t i = 0; i < count; i++) {
+      uint8_t enabled;
+      std::string key;
+      posthog::FeatureFlagValue flag;
+      if (!reader.ReadByte(&enabled) || !reader.ReadString(&key) ||
+          !reader.ReadString(&flag.variant) || !reader.ReadString(&flag.payload_json)) {
+        flags->clear();
+        return false;
       }
-      std::string value = json.substr(pos, end - pos);
-      // Trim whitespace
-      value.erase(0, value.find_first_not_of(" \t"));
-      value.erase(value.find_last_not_of(" \t") + 1);
-      return value;
+      flag.enabled = enabled != 0;
+      flags->emplace(std::move(key), std::move(flag));
     }
+    return true;
   }
+
+  // Single-pass SAX handler for flag responses. Understands both the /decide/
+  // shape ({"featureFlags": {key: bool|variant}, "featureFlagPayloads": {key: json}})
+  // and the /flags/ v2 shape ({"flags": {key: {"enabled", "variant",
+  // "metadata": {"payload"}}}}). Everything else is skipped without building a DOM.
+  class FlagsSaxHandler : public nlohmann::json_sax<json> {
+   public:
+    explicit FlagsSaxHandler(FeatureFlagMap* flags)
+        : flags_(flags), partial_(false), capture_depth_(0) {}
+
+    bool partial() const { return partial_; }
+
+    bool null() override { return Value([](auto& sax) { return sax.null(); }, nullptr); }
+    bool boolean(bool val) override { return Value([val](auto& sax) { return sax.boolean(val); }, &val); }
+    bool number_integer(number_integer_t val) override {
+      return Value([val](auto& sax) { return sax.number_integer(val); }, nullptr);
+    }
+    bool number_unsigned(number_unsigned_t val) override {
+      return Value([val](auto& sax) { return sax.number_unsigned(val); }, nullptr);
+    }
+    bool number_float(number_float_t val, const string_t& s) override {
+      return Value([val, &s](auto& sax) { return sax.number_float(val, s); }, nullptr);
+    }
+    bool string(string_t& val) override {
+      if (capture_depth_ > 0) {
+        return capture_->string(val);
+      }
+      switch (Classify()) {
+        case Slot::kDecideFlag:
+        case Slot::kFlagsVariant:
+          SetVariant(CurrentFlag(1), std::move(val));
+          break;
+        case Slot::kDecidePayload:
+        case Slot::kFlagsPayload:
+          // PostHog sends payloads as JSON-encoded strings
+          (*flags_)[PayloadKey()].payload_json = std::move(val);
+          break;
+        default:
+          break;
+      }
+      return true;
+    }
+    bool binary(binary_t& val) override { return capture_depth_ > 0 ? capture_->binary(val) : true; }
+
+    bool start_object(std::size_t elements) override {
+      return StartContainer(true, [elements](auto& sax) { return sax.start_object(elements); });
+    }
+    bool key(string_t& val) override {
+      if (capture_depth_ > 0) {
+        return capture_->key(val);
+      }
+      // The lexer clears its buffer before the next token, so the key can be moved out
+      frames_.back().key = std::move(val);
+      return true;
+    }
+    bool end_object() override {
+      return EndContainer([](auto& sax) { return sax.end_object(); });
+    }
+    bool start_array(std::size_t elements) override {
+      return StartContainer(false, [elements](auto& sax) { return sax.start_array(elements); });
+    }
+    bool end_array() override {
+      return EndContainer([](auto& sax) { return sax.end_array(); });
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception&) override {
+      return false;
+    }
+
+   private:
+    enum class Slot { kOther, kDecideFlag, kDecidePayload, kFlagsEnabled, kFlagsVariant, kFlagsPayload, kErrors };
+
+    struct Frame {
+      bool is_object;
+      std::string key;
+    };
+
+    // Where the value that is about to be reported sits in the document
+    Slot Classify() const {
+      size_t depth = frames_.size();
+      if (depth == 0 || !frames_[0].is_object) {
+        return Slot::kOther;
+      }
+      const std::string& section = frames_[0].key;
+      if (depth == 1 && section == "errorsWhileComputingFlags") {
+        return Slot::kErrors;
+      }
+      if (depth == 2 && frames_[1].is_object) {
+        if (section == "featureFlags") return Slot::kDecideFlag;
+        if (section == "featureFlagPayloads") return Slot::kDecidePayload;
+      }
+      if (section == "flags") {
+        if (depth == 3 && frames_[2].is_object) {
+          if (frames_[2].key == "enabled") return Slot::kFlagsEnabled;
+          if (frames_[2].key == "variant") return Slot::kFlagsVariant;
+        }
+        if (depth == 4 && frames_[2].key == "metadata" && frames_[3].key == "payload") {
+          return Slot::kFlagsPayload;
+        }
+      }
+      return Slot::kOther;
+    }
+
+    posthog::FeatureFlagValue& CurrentFlag(size_t key_depth) {
+      return (*flags_)[frames_[key_depth].key];
+    }
+
+    const std::string& PayloadKey() const { return frames_[1].key; }
+
+    static void SetVariant(posthog::FeatureFlagValue& flag, std::string variant) {
+      flag.enabled = !variant.empty();
+      flag.variant = std::move(variant);
+    }
+
+    template <typename Forward>
+    bool Value(Forward forward, const bool* bool_value) {
+      if (capture_depth_ > 0) {
+        return forward(*capture_);
+      }
+      Slot slot = Classify();
+      if (bool_value) {
+        if (slot == Slot::kDecideFlag || slot == Slot::kFlagsEnabled) {
+          posthog::FeatureFlagValue& flag = CurrentFlag(1);
+          flag.enabled = *bool_value;
+          if (slot == Slot::kDecideFlag) {
+            flag.variant.clear();
+          }
+        } else if (slot == Slot::kErrors) {
+          partial_ = *bool_value;
+        }
+      }
+      if ((slot == Slot::kDecidePayload || slot == Slot::kFlagsPayload)) {
+        // Non-string payloads (numbers, booleans) are kept as their JSON text
+        json scalar;
+        nlohmann::detail::json_sax_dom_parser<json> dom(scalar, false);
+        forward(dom);
+        if (!scalar.is_null()) {
+          (*flags_)[PayloadKey()].payload_json = scalar.dump();
+        }
+      }
+      return true;
+    }
+
+    template <typename Forward>
+    bool StartContainer(bool is_object, Forward forward) {
+      if (capture_depth_ > 0) {
+        capture_depth_++;
+        return forward(*capture_);
+      }
+      Slot slot = Classify();
+      if (slot == Slot::kDecidePayload || slot == Slot::kFlagsPayload) {
+        // Object/array payload: build just this subtree and serialize it once it closes
+        capture_key_ = PayloadKey();
+        capture_value_ = json();
+        capture_ = std::make_unique<nlohmann::detail::json_sax_dom_parser<json>>(capture_value_, false);
+        capture_depth_ = 1;
+        return forward(*capture_);
+      }
+      frames_.push_back(Frame{is_object, std::string()});
+      return true;
+    }
+
+    template <typename Forward>
+    bool EndContainer(Forward forward) {
+      if (capture_depth_ > 0) {
+        bool result = forward(*capture_);
+        if (--capture_depth_ == 0) {
+          (*flags_)[capture_key_].payload_json = capture_value_.dump();
+          capture_.reset();
+        }
+        return result;
+      }
+      frames_.pop_back();
+      return true;
+    }
+
+    FeatureFlagMap* flags_;
+    bool partial_;
+    std::vector<Frame> frames_;
+
+    // Active while a structured payload is being copied
+    std::unique_ptr<nlohmann::detail::json_sax_dom_parser<json>> capture_;
+    json capture_value_;
+    std::string capture_key_;
+    int capture_depth_;
+  };
 }
 
 FeatureFlagsManager::FeatureFlagsManager(HttpClient* http_client, StorageManager* storage_manager)
-    : http_client_(http_client), storage_manager_(storage_manager) {
+    : http_client_(http_client),
+      storage_manager_(storage_manager),
+      executor_(nullptr),
+      snapshot_(std::make_shared<FlagSnapshot>()),
+      last_body_hash_(0),
+      last_validated_us_(0),
+      cancelled_(false),
+      context_(std::make_shared<EvaluationContext>()) {
   LoadCachedFlags();
 }
 
 void FeatureFlagsManager::LoadCachedFlags() {
-  std::string cached_flags = storage_manager_->GetFeatureFlags();
-  if (!cached_flags.empty() && cached_flags != "{}") {
-    ParseFlagsResponse(cached_flags);
+  ScopedTimer timer("flags.cache_load");
+  std::string distinct_id = storage_manager_->GetDistinctId();
+  auto empty = std::make_shared<FlagSnapshot>();
+  empty->distinct_id = distinct_id;
+  std::atomic_store(&snapshot_, std::shared_ptr<const FlagSnapshot>(std::move(empty)));
+  
+  std::string cache = storage_manager_->GetFeatureFlagCache(distinct_id);
+  
+  if (cache.empty()) {
+    // Cache written by an older version: parse the raw response once and store it in the new form
+    std::string legacy_flags = storage_manager_->GetLegacyFeatureFlags();
+    if (!legacy_flags.empty() && legacy_flags != "{}") {
+      std::shared_ptr<const FlagSnapshot> migrated = ApplyFlagsResponse(distinct_id, legacy_flags, false);
+      if (migrated) {
+        storage_manager_->SetFeatureFlagCache(distinct_id, EncodeFlagCache(migrated->flags), kCachedIdentities);
+      }
+    }
+    return;
   }
-}
-
-void FeatureFlagsManager::ParseFlagsResponse(const std::string& response_json) {
-  flags_cache_.clear();
   
-  // Look for "featureFlags" key in response
-  std::string flags_json = ExtractJsonValue(response_json, "featureFlags");
-  if (flags_json.empty() || flags_json[0] != '{') {
+  auto snapshot = std::make_shared<FlagSnapshot>();
+  snapshot->distinct_id = distinct_id;
+  if (!DecodeFlagCache(cache, &snapshot->flags)) {
+    PostHogLogger::Error("Ignoring unreadable feature flag cache");
     return;
   }
   
-  // Simple parsing of feature flags object
-  // This is a simplified parser - for production use a proper JSON library
-  size_t pos = 1; // Skip opening {
-  while (pos < flags_json.length()) {
-    // Find key
-    size_t key_start = flags_json.find('"', pos);
-    if (key_start == std::string::npos) break;
-    key_start++;
-    size_t key_end = flags_json.find('"', key_start);
-    if (key_end == std::string::npos) break;
-    std::string key = flags_json.substr(key_start, key_end - key_start);
-    
-    // Find value
-    pos = flags_json.find(':', key_end);
-    if (pos == std::string::npos) break;
-    pos++;
+  size_t flag_count = snapshot->flags.size();
+  std::shared_ptr<const FlagSnapshot> loaded(std::move(snapshot));
+  {
+    std::lock_guard<std::mutex> lock(update_mutex_);
+    RememberSnapshot(loaded);
+    std::atomic_store(&snapshot_, loaded);
+  }
+  PostHogLogger::Debug("Loaded " + std::to_string(flag_count) + " cached feature flags in "
+                       + std::to_string(timer.ElapsedMicros()) + "us");
+}
+
+bool FeatureFlagsManager::ParseFlagsResponse(const std::string& response_json,
+                                             FeatureFlagMap* flags,
+                                             bool* partial) {
+  FlagsSaxHandler handler(flags);
+  bool ok = json::sax_parse(response_json, &handler, json::input_format_t::json, false);
+  if (partial) {
+    *partial = handler.partial();
+  }
+  return ok;
+}
+
+std::shared_ptr<const FlagSnapshot> FeatureFlagsManager::ApplyFlagsResponse(const std::string& distinct_id,
+                                                                           const std::string& response_json,
+                                                                           bool merge) {
+  auto snapshot = std::make_shared<FlagSnapshot>();
+  snapshot->distinct_id = distinct_id;
+  bool partial = false;
+  if (!ParseFlagsResponse(response_json, &snapshot->flags, &partial)) {
+    return nullptr;
+  }
+  
+  std::shared_ptr<const FlagsChangedCallback> callback = std::atomic_load(&flags_changed_callback_);
+  std::shared_ptr<const FlagSnapshot> applied;
+  std::vector<std::string> changed_keys;
+  {
+    std::lock_guard<std::mutex> lock(update_mutex_);
+    std::shared_ptr<const FlagSnapshot> current = std::atomic_load(&snapshot_);
+    // The identity may have switched while this request was in flight
+    bool active = current->distinct_id == distinct_id;
+    if (merge || partial) {
+      // Flags not in this response (filtered out or failed to evaluate) keep their
+      // previous values. Bootstrap values are left out so they are never persisted.
+      std::shared_ptr<const FlagSnapshot> previous = active ? current : FindCachedSnapshot(distinct_id);
+      if (previous && !previous->bootstrap) {
+        for (const auto& entry : previous->flags) {
+          snapshot->flags.emplace(entry.first, entry.second);
+        }
+      }
+    }
+    applied = std::move(snapshot);
+    RememberSnapshot(applied);
     
-    // Skip whitespace
-    while (pos < flags_json.length() && (flags_json[pos] == ' ' || flags_json[pos] == '\t')) pos++;
+    if (active) {
+      if (callback) {
+        changed_keys = DiffFlags(current->flags, applied->flags);
+      }
+      std::atomic_store(&snapshot_, applied);
+    } else {
+      PostHogMetrics::Increment("flags.inactive_identity_responses");
+    }
+  }
+  
+  NotifyFlagsChanged(callback, changed_keys);
+  return applied;
+}
+
+bool FeatureFlagsManager::Bootstrap(const std::string& flags_json) {
+  auto snapshot = std::make_shared<FlagSnapshot>();
+  snapshot->bootstrap = true;
+  if (!ParseFlagsResponse(flags_json, &snapshot->flags, nullptr)) {
+    PostHogLogger::Error("Ignoring invalid bootstrap feature flags");
+    return false;
+  }
+  
+  std::lock_guard<std::mutex> lock(update_mutex_);
+  // Several sources (file, then inline values) are layered; later ones win
+  for (const auto& entry : bootstrap_flags_) {
+    snapshot->flags.emplace(entry.first, entry.second);
+  }
+  bootstrap_flags_ = snapshot->flags;
+  
+  std::shared_ptr<const FlagSnapshot> current = std::atomic_load(&snapshot_);
+  if (!current->bootstrap && !current->flags.empty()) {
+    // Cached flags from a real response are more recent than anything bundled with the app
+    return false;
+  }
+  snapshot->distinct_id = current->distinct_id;
+  std::atomic_store(&snapshot_, std::shared_ptr<const FlagSnapshot>(std::move(snapshot)));
+  return true;
+}
+
+void FeatureFlagsManager::SwitchIdentity(const std::string& distinct_id) {
+  std::shared_ptr<const FlagsChangedCallback> callback = std::atomic_load(&flags_changed_callback_);
+  std::vector<std::string> changed_keys;
+  {
+    std::lock_guard<std::mutex> lock(update_mutex_);
+    std::shared_ptr<const FlagSnapshot> current = std::atomic_load(&snapshot_);
+    if (current->distinct_id == distinct_id) {
+      return;
+    }
     
-    if (pos >= flags_json.length()) break;
+    std::shared_ptr<const FlagSnapshot> next = FindCachedSnapshot(distinct_id);
+    if (!next) {
+      std::string cache = storage_manager_->GetFeatureFlagCache(distinct_id);
+      auto loaded = std::make_shared<FlagSnapshot>();
+      loaded->distinct_id = distinct_id;
+      if (!cache.empty() && DecodeFlagCache(cache, &loaded->flags)) {
+        next = std::move(loaded);
+        RememberSnapshot(next);
+      }
+    }
     
-    // Extract value
-    std::string value;
-    if (flags_json[pos] == '"') {
-      // String value
-      pos++;
-      size_t value_end = flags_json.find('"', pos);
-      if (value_end == std::string::npos) break;
-      value = flags_json.substr(pos, value_end - pos);
-      pos = value_end + 1;
+    if (next) {
+      PostHogMetrics::Increment("flags.identity_cache_hits");
     } else {
-      // Boolean or other
-      size_t value_end = pos;
-      while (value_end < flags_json.length() && 
-             flags_json[value_end] != ',' && 
-             flags_json[value_end] != '}') {
-        value_end++;
-      }
-      value = flags_json.substr(pos, value_end - pos);
-      // Trim whitespace
-      value.erase(0, value.find_first_not_of(" \t"));
-      value.erase(value.find_last_not_of(" \t") + 1);
-      pos = value_end;
+      // Nothing cached for this person. The current flags were evaluated for
+      // someone else, so start from the bootstrap values until their reload lands.
+      PostHogMetrics::Increment("flags.identity_cache_misses");
+      auto fresh = std::make_shared<FlagSnapshot>();
+      fresh->distinct_id = distinct_id;
+      fresh->flags = bootstrap_flags_;
+      fresh->bootstrap = !bootstrap_flags_.empty();
+      next = std::move(fresh);
+      // The served flags no longer match the last response, so it can't be reused as a validator
+      last_request_key_.clear();
+      last_etag_.clear();
     }
     
-    flags_cache_[key] = value;
-    
-    // Move to next entry
-    pos = flags_json.find(',', pos);
-    if (pos == std::string::npos) break;
-    pos++;
+    if (callback) {
+      changed_keys = DiffFlags(current->flags, next->flags);
+    }
+    std::atomic_store(&snapshot_, next);
   }
   
-  // Cache the flags
-  storage_manager_->SetFeatureFlags(response_json);
+  NotifyFlagsChanged(callback, changed_keys);
+}
+
+void FeatureFlagsManager::NotifyFlagsChanged(const std::shared_ptr<const FlagsChangedCallback>& callback,
+                                             const std::vector<std::string>& changed_keys) {
+  if (callback && !changed_keys.empty()) {
+    PostHogMetrics::Increment("flags.changed_keys", static_cast<int64_t>(changed_keys.size()));
+    (*callback)(changed_keys);
+  }
+}
+
+void FeatureFlagsManager::RememberSnapshot(std::shared_ptr<const FlagSnapshot> snapshot) {
+  for (auto it = identity_cache_.begin(); it != identity_cache_.end(); ++it) {
+    if ((*it)->distinct_id == snapshot->distinct_id) {
+      identity_cache_.erase(it);
+      break;
+    }
+  }
+  identity_cache_.push_front(std::move(snapshot));
+  if (identity_cache_.size() > kCachedIdentities) {
+    identity_cache_.pop_back();
+  }
+}
+
+std::shared_ptr<const FlagSnapshot> FeatureFlagsManager::FindCachedSnapshot(const std::string& distinct_id) {
+  for (auto it = identity_cache_.begin(); it != identity_cache_.end(); ++it) {
+    if ((*it)->distinct_id == distinct_id) {
+      identity_cache_.splice(identity_cache_.begin(), identity_cache_, it);
+      return identity_cache_.front();
+    }
+  }
+  return nullptr;
+}
+
+void FeatureFlagsManager::SetFlagsChangedCallback(FlagsChangedCallback callback) {
+  std::shared_ptr<const FlagsChangedCallback> stored;
+  if (callback) {
+    stored = std::make_shared<const FlagsChangedCallback>(std::move(callback));
+  }
+  std::atomic_store(&flags_changed_callback_, stored);
+}
+
+void FeatureFlagsManager::ReloadFeatureFlagsAsync(const std::string& distinct_id,
+                                                  const std::map<std::string, std::string>& properties,
+                                                  ReloadCallback callback,
+                                                  const std::vector<std::string>& flag_keys) {
+  std::string request_key = MakeRequestKey(distinct_id, properties, flag_keys);
+  
+  {
+    std::lock_guard<std::mutex> lock(reload_mutex_);
+    auto it = inflight_reloads_.find(request_key);
+    if (it != inflight_reloads_.end()) {
+      PostHogMetrics::Increment("flags.reloads_merged");
+      if (callback) {
+        it->second.push_back(std::move(callback));
+      }
+      return;
+    }
+    std::vector<ReloadCallback>& callbacks = inflight_reloads_[request_key];
+    if (callback) {
+      callbacks.push_back(std::move(callback));
+    }
+  }
+  
+  auto task = [this, request_key, distinct_id, properties, flag_keys]() {
+    bool success = false;
+    try {
+      success = ReloadFeatureFlags(distinct_id, properties, flag_keys);
+    } catch (const std::exception& e) {
+      PostHogLogger::Error("Error reloading feature flags: " + std::string(e.what()));
+    }
+    
+    std::vector<ReloadCallback> callbacks;
+    {
+      std::lock_guard<std::mutex> lock(reload_mutex_);
+      auto it = inflight_reloads_.find(request_key);
+      if (it != inflight_reloads_.end()) {
+        callbacks.swap(it->second);
+        inflight_reloads_.erase(it);
+      }
+    }
+    for (const auto& callback : callbacks) {
+      callback(success);
+    }
+  };
+  
+  if (!executor_ || !executor_->Post(task)) {
+    task();
+  }
 }
 
 bool FeatureFlagsManager::ReloadFeatureFlags(const std::string& distinct_id,
-                                             const std::map<std::string, std::string>& properties) {
-  HttpResponse response = http_client_->PostDecide(distinct_id, properties);
+                                             const std::map<std::string, std::string>& properties,
+                                             const std::vector<std::string>& flag_keys) {
+  bool full_reload = flag_keys.empty();
+  std::string request_key = MakeRequestKey(distinct_id, properties, flag_keys);
+  
+  std::string etag;
+  if (full_reload) {
+    std::lock_guard<std::mutex> lock(update_mutex_);
+    if (request_key == last_request_key_) {
+      etag = last_etag_;
+    }
+  }
+  
+  if (cancelled_.load()) {
+    return false;
+  }
+  HttpResponse response = http_client_->PostDecide(distinct_id, properties, flag_keys, etag, &cancelled_);
   
-  if (response.success && !response.body.empty()) {
-    ParseFlagsResponse(response.body);
+  if (response.status_code == 304) {
+    PostHogMetrics::Increment("flags.not_modified");
+    last_validated_us_.store(PostHogMetrics::NowMicros(), std::memory_order_relaxed);
     return true;
   }
+  if (!response.success || response.body.empty()) {
+    return false;
+  }
+  
+  size_t body_hash = std::hash<std::string>{}(response.body);
+  if (full_reload) {
+    std::lock_guard<std::mutex> lock(update_mutex_);
+    if (request_key == last_request_key_ && body_hash == last_body_hash_) {
+      // Same flags as last time: nothing to parse or write
+      last_etag_ = response.etag;
+      PostHogMetrics::Increment("flags.unchanged");
+      last_validated_us_.store(PostHogMetrics::NowMicros(), std::memory_order_relaxed);
+      return true;
+    }
+  }
+  
+  std::shared_ptr<const FlagSnapshot> applied = ApplyFlagsResponse(distinct_id, response.body, !full_reload);
+  if (!applied) {
+    return false;
+  }
   
-  return false;
+  // The merged snapshot is cached, so filtered reloads persist too
+  storage_manager_->SetFeatureFlagCache(distinct_id, EncodeFlagCache(applied->flags), kCachedIdentities);
+  if (full_reload) {
+    std::lock_guard<std::mutex> lock(update_mutex_);
+    last_request_key_ = request_key;
+    last_etag_ = response.etag;
+    last_body_hash_ = body_hash;
+    last_validated_us_.store(PostHogMetrics::NowMicros(), std::memory_order_relaxed);
+  }
+  return true;
 }
 
-bool FeatureFlagsManager::IsFeatureEnabled(const std::string& flag_key) {
-  auto it = flags_cache_.find(flag_key);
-  if (it == flags_cache_.end()) {
+std::shared_ptr<const FlagSnapshot> FeatureFlagsManager::GetSnapshot() const {
+  return std::atomic_load(&snapshot_);
+}
+
+bool FeatureFlagsManager::LoadFlagDefinitions(const std::string& secure_api_key) {
+  if (cancelled_.load()) {
     return false;
   }
+  HttpResponse response = http_client_->GetLocalEvaluation(secure_api_key, &cancelled_);
+  if (cancelled_.load()) {
+    return false;
+  }
+  if (!response.success || !local_evaluator_.LoadDefinitions(response.body)) {
+    PostHogLogger::Error("Failed to load feature flag definitions: HTTP " + std::to_string(response.status_code));
+    return false;
+  }
+  return true;
+}
+
+void FeatureFlagsManager::SetEvaluationContext(const std::string& distinct_id, const json& person_properties) {
+  auto context = std::make_shared<EvaluationContext>();
+  context->distinct_id = distinct_id;
+  context->person_properties = person_properties.is_object() ? person_properties : json::object();
+  // Matches the server-side SDKs, which always expose distinct_id as a person property
+  context->person_properties["distinct_id"] = distinct_id;
+  std::atomic_store(&context_, std::shared_ptr<const EvaluationContext>(std::move(context)));
+  SwitchIdentity(distinct_id);
+}
+
+json FeatureFlagsManager::GetPersonProperties() const {
+  return std::atomic_load(&context_)->person_properties;
+}
+
+bool FeatureFlagsManager::ResolveFlag(const std::string& flag_key, posthog::FeatureFlagValue* flag) const {
+  std::shared_ptr<const EvaluationContext> context = std::atomic_load(&context_);
+  if (!context->distinct_id.empty() &&
+      local_evaluator_.Evaluate(flag_key, context->distinct_id, context->person_properties, flag)) {
+    return true;
+  }
   
-  std::string value = it->second;
-  // Check if value is true or a non-empty string
-  return (value == "true" || value == "1" || (value[0] == '"' && value.length() > 2));
+  // Not decidable on-device: use what /flags/ returned
+  std::shared_ptr<const FlagSnapshot> snapshot = GetSnapshot();
+  auto it = snapshot->flags.find(flag_key);
+  if (it == snapshot->flags.end()) {
+    return false;
+  }
+  *flag = it->second;
+  return true;
+}
+
+bool FeatureFlagsManager::IsFeatureEnabled(const std::string& flag_key) {
+  posthog::FeatureFlagValue flag;
+  return ResolveFlag(flag_key, &flag) && flag.enabled;
 }
 
 std::string FeatureFlagsManager::GetFeatureFlag(const std::string& flag_key) {
-  auto it = flags_cache_.find(flag_key);
-  if (it == flags_cache_.end()) {
+  posthog::FeatureFlagValue flag;
+  if (!ResolveFlag(flag_key, &flag)) {
     return "";
   }
   
-  std::string value = it->second;
-  // Remove quotes if present
-  if (value.length() >= 2 && value[0] == '"' && value.back() == '"') {
-    return value.substr(1, value.length() - 2);
+  if (!flag.variant.empty()) {
+    return flag.variant;
   }
-  return value;
+  return flag.enabled ? "true" : "false";
 }
 
 std::string FeatureFlagsManager::GetFeatureFlagPayload(const std::string& flag_key) {
-  // For now, return empty string - payload support can be added later
-  return "";
+  posthog::FeatureFlagValue flag;
+  return ResolveFlag(flag_key, &flag) ? flag.payload_json : "";
 }
 
+FeatureFlagMap FeatureFlagsManager::GetAllFlags() const {
+  std::shared_ptr<const FlagSnapshot> snapshot = GetSnapshot();
+  if (!local_evaluator_.HasDefinitions()) {
+    return snapshot->flags;
+  }
+  
+  FeatureFlagMap flags;
+  flags.reserve(snapshot->flags.size());
+  for (const auto& entry : snapshot->flags) {
+    ResolveFlag(entry.first, &flags[entry.first]);
+  }
+  // Flags only known from the downloaded definitions
+  for (const std::string& flag_key : local_evaluator_.GetFlagKeys()) {
+    posthog::FeatureFlagValue flag;
+    if (flags.count(flag_key) == 0 && ResolveFlag(flag_key, &flag)) {
+      flags.emplace(flag_key, std::move(flag));
+    }
+  }
+  return flags;
+}
@@ -1,29 +1,155 @@
 #ifndef FEATURE_FLAGS_MANAGER_H_
 #define FEATURE_FLAGS_MANAGER_H_
 
+#include <atomic>
+#include <cstdint>
 #include <string>
 #include <map>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 #include "http_client.h"
 #include "storage_manager.h"
+#include "posthog_models.h"
+#include "local_flag_evaluator.h"
+
+class TaskExecutor;
+
+using FeatureFlagMap = std::unordered_map<std::string, posthog::FeatureFlagValue>;
+
+// Immutable set of flags from one /decide/ response. Readers hold a
+// shared_ptr to it, so a reload never changes what they are looking at.
+struct FlagSnapshot {
+  std::string distinct_id;  // Whose flags these are
+  FeatureFlagMap flags;
+  bool bootstrap = false;   // Seeded by the app rather than fetched
+};
+
+// Identity that flags are evaluated locally for
+struct EvaluationContext {
+  std::string distinct_id;
+  json person_properties;
+};
 
 class FeatureFlagsManager {
  public:
+  // Invoked on a worker thread with whether the reload succeeded
+  using ReloadCallback = std::function<void(bool)>;
+  // Invoked on the reloading thread, once the new snapshot is being served, with
+  // the keys that were added, changed or removed
+  using FlagsChangedCallback = std::function<void(const std::vector<std::string>&)>;
+
   FeatureFlagsManager(HttpClient* http_client, StorageManager* storage_manager);
   
+  // Executor used by ReloadFeatureFlagsAsync; reloads run inline without one
+  void SetExecutor(TaskExecutor* executor) { executor_ = executor; }
+
+  // Called after each reload that changes at least one flag; pass nullptr to stop
+  void SetFlagsChangedCallback(FlagsChangedCallback callback);
+
+  // For shutdown: aborts flag requests in flight and makes queued and later
+  // reloads fail straight away, so the executor can drain without waiting on
+  // the network. Not reversible.
+  void Cancel() { cancelled_.store(true); }
+
+  // Reload in the background. A request matching one already in flight
+  // (same distinct_id, properties and flag keys) is merged into it rather than sent again.
+  void ReloadFeatureFlagsAsync(const std::string& distinct_id,
+                               const std::map<std::string, std::string>& properties,
+                               ReloadCallback callback,
+                               const std::vector<std::string>& flag_keys = {});
+
+  // With flag_keys only those flags are fetched and merged into the snapshot.
+  // Full reloads are conditional: an unchanged response skips parsing and storage.
   bool ReloadFeatureFlags(const std::string& distinct_id,
-                          const std::map<std::string, std::string>& properties);
+                          const std::map<std::string, std::string>& properties,
+                          const std::vector<std::string>& flag_keys = {});
   bool IsFeatureEnabled(const std::string& flag_key);
   std::string GetFeatureFlag(const std::string& flag_key);
   std::string GetFeatureFlagPayload(const std::string& flag_key);
 
+  // Every known flag resolved the same way as the single-flag getters
+  FeatureFlagMap GetAllFlags() const;
+
+  // Seed flags before anything has been fetched, from a /decide/-shaped document
+  // ({"featureFlags": ..., "featureFlagPayloads": ...}) supplied by the app.
+  // Ignored once real flags are present; the first reload replaces them. Not persisted.
+  // Also what an identity with no cached flags starts from.
+  bool Bootstrap(const std::string& flags_json);
+
+  // Current flags. Never blocks; safe to call from any thread.
+  std::shared_ptr<const FlagSnapshot> GetSnapshot() const;
+
+  // Steady-clock time (PostHogMetrics::NowMicros) of the last successful full
+  // reload, including ones the server answered with "not modified". 0 if flags
+  // have only been loaded from the cache so far.
+  int64_t GetLastValidatedMicros() const { return last_validated_us_.load(std::memory_order_relaxed); }
+
+  // Download flag definitions so flags can be evaluated on-device. Lookups
+  // use the local result when it is conclusive and the /flags/ result otherwise.
+  bool LoadFlagDefinitions(const std::string& secure_api_key);
+
+  // Who flags are evaluated and served for; update on identify, alias and reset.
+  // Switching identity serves that person's cached flags straight away when
+  // any are cached, otherwise only the bootstrap values (if any) until their
+  // reload lands. Flags evaluated for one person are never served to another.
+  void SetEvaluationContext(const std::string& distinct_id, const json& person_properties);
+
+  // Person properties of the current evaluation context
+  json GetPersonProperties() const;
+
+  // Parse a /decide/ (featureFlags + featureFlagPayloads) or /flags/ response in a
+  // single pass. Returns false if the body is not valid JSON. Sets *partial when
+  // the server reported errors, in which case the result should be merged.
+  static bool ParseFlagsResponse(const std::string& response_json,
+                                 FeatureFlagMap* flags,
+                                 bool* partial);
+
  private:
   HttpClient* http_client_;
   StorageManager* storage_manager_;
-  std::map<std::string, std::string> flags_cache_;
+  TaskExecutor* executor_;
+  // Only accessed through std::atomic_load/std::atomic_store
+  std::shared_ptr<const FlagSnapshot> snapshot_;
+  std::mutex update_mutex_;  // Serializes writers only
+
+  // Validators of the last applied full response, guarded by update_mutex_
+  std::string last_request_key_;
+  std::string last_etag_;
+  size_t last_body_hash_;
+  std::atomic<int64_t> last_validated_us_;
+  std::atomic<bool> cancelled_;
+
+  std::shared_ptr<const FlagsChangedCallback> flags_changed_callback_;  // atomic_load/atomic_store only
+
+  // Snapshots of recently active identities, most recent first; guarded by update_mutex_
+  std::list<std::shared_ptr<const FlagSnapshot>> identity_cache_;
+
+  // Every bootstrap source layered together; guarded by update_mutex_
+  FeatureFlagMap bootstrap_flags_;
+
+  LocalFlagEvaluator local_evaluator_;
+  std::shared_ptr<const EvaluationContext> context_;  // atomic_load/atomic_store only
+
+  // Callbacks waiting on each in-flight reload, keyed by its request
+  std::mutex reload_mutex_;
+  std::map<std::string, std::vector<ReloadCallback>> inflight_reloads_;
   
-  void ParseFlagsResponse(const std::string& response_json);
+  // Returns the snapshot built for distinct_id, or nullptr if the response didn't
+  // parse. It is only served if distinct_id is still the active identity.
+  std::shared_ptr<const FlagSnapshot> ApplyFlagsResponse(const std::string& distinct_id,
+                                                         const std::string& response_json, bool merge);
+  void SwitchIdentity(const std::string& distinct_id);
+  void NotifyFlagsChanged(const std::shared_ptr<const FlagsChangedCallback>& callback,
+                          const std::vector<std::string>& changed_keys);
+  // Both require update_mutex_
+  void RememberSnapshot(std::shared_ptr<const FlagSnapshot> snapshot);
+  std::shared_ptr<const FlagSnapshot> FindCachedSnapshot(const std::string& distinct_id);
+  bool ResolveFlag(const std::string& flag_key, posthog::FeatureFlagValue* flag) const;
   void LoadCachedFlags();
 };
 
 #endif  // FEATURE_FLAGS_MANAGER_H_
-
@@ -0,0 +1,33 @@
+#include "flag_exposure_tracker.h"
+
+FlagExposureTracker::FlagExposureTracker(size_t max_cache_size) : max_cache_size_(max_cache_size) {}
+
+bool FlagExposureTracker::Record(const std::string& distinct_id, const std::string& flag_key, const json& response) {
+  std::string cache_key = distinct_id;
+  cache_key += '\0';
+  cache_key += flag_key;
+  cache_key += '\0';
+  cache_key += response.is_string() ? response.get<std::string>() : response.dump();
+
+  if (reported_.count(cache_key) > 0) {
+    return false;
+  }
+
+  // Bounded like the other SDKs: start over rather than grow forever
+  if (reported_.size() >= max_cache_size_) {
+    reported_.clear();
+  }
+  reported_.insert(std::move(cache_key));
+  pending_.push_back(Exposure{distinct_id, flag_key, response});
+  return true;
+}
+
+std::vector<FlagExposureTracker::Exposure> FlagExposureTracker::TakePending() {
+  std::vector<Exposure> pending;
+  pending.swap(pending_);
+  return pending;
+}
+
+void FlagExposureTracker::Clear() {
+  reported_.clear();
+}
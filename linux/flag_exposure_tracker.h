@@ -0,0 +1,39 @@
+#ifndef FLAG_EXPOSURE_TRACKER_H_
+#define FLAG_EXPOSURE_TRACKER_H_
+
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "posthog_models.h"
+
+// Decides which flag reads become $feature_flag_called events. Each
+// (distinct_id, flag, value) combination is reported once; repeated reads of
+// the same flag (e.g. every frame) are dropped in memory. Reported exposures
+// are collected and handed out in batches. Main thread only.
+class FlagExposureTracker {
+ public:
+  struct Exposure {
+    std::string distinct_id;
+    std::string flag_key;
+    json response;
+  };
+
+  explicit FlagExposureTracker(size_t max_cache_size);
+
+  // Returns true if this is the first read of this value for this user,
+  // in which case the exposure is queued
+  bool Record(const std::string& distinct_id, const std::string& flag_key, const json& response);
+
+  std::vector<Exposure> TakePending();
+  size_t GetPendingCount() const { return pending_.size(); }
+
+  // Forget what has been reported (e.g. after reset)
+  void Clear();
+
+ private:
+  size_t max_cache_size_;
+  std::unordered_set<std::string> reported_;
+  std::vector<Exposure> pending_;
+};
+
+#endif  // FLAG_EXPOSURE_TRACKER_H_
@@ -0,0 +1,136 @@
+#include "flush_coordinator.h"
+#include "storage_manager.h"
+#include "http_client.h"
+#include "posthog_logger.h"
+#include "posthog_metrics.h"
+#include "uuid_generator.h"
+
+// How many uploaded row IDs are remembered for duplicate detection
+static const size_t kRecentSentCapacity = 4096;
+
+FlushCoordinator::FlushCoordinator(StorageManager* storage_manager, HttpClient* http_client, int max_batch_size)
+    : storage_manager_(storage_manager),
+      http_client_(http_client),
+      max_batch_size_(max_batch_size > 0 ? max_batch_size : 1),
+      draining_(false),
+      requested_generation_(0),
+      completed_generation_(0),
+      last_result_(true),
+      cancelled_(false),
+      sent_count_(0),
+      duplicate_count_(0),
+      consecutive_failures_(0) {}
+
+bool FlushCoordinator::Flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  uint64_t ticket = ++requested_generation_;
+
+  if (draining_) {
+    // Another caller is draining; it will pick up our request on its next pass
+    PostHogMetrics::Increment("flush.coalesced");
+    done_cv_.wait(lock, [this, ticket] { return completed_generation_ >= ticket; });
+    return last_result_;
+  }
+
+  draining_ = true;
+  while (completed_generation_ < requested_generation_) {
+    uint64_t target = requested_generation_;
+    lock.unlock();
+    bool result = Drain();
+    if (result) {
+      consecutive_failures_.store(0, std::memory_order_relaxed);
+    } else {
+      consecutive_failures_.fetch_add(1, std::memory_order_relaxed);
+    }
+    lock.lock();
+    last_result_ = result;
+    completed_generation_ = target;
+    done_cv_.notify_all();
+  }
+  draining_ = false;
+  return last_result_;
+}
+
+void FlushCoordinator::Cancel() {
+  cancelled_.store(true);
+}
+
+bool FlushCoordinator::Drain() {
+  ScopedTimer timer("flush.drain");
+
+  while (!cancelled_.load()) {
+    std::string lease_id = posthog::GenerateUuid();
+    std::vector<std::string> events = storage_manager_->LeaseQueuedEvents(max_batch_size_, lease_id);
+    if (events.empty()) {
+      return true;
+    }
+
+    std::vector<std::string> event_jsons;
+    std::vector<std::string> event_ids;
+    event_jsons.reserve(events.size());
+    event_ids.reserve(events.size());
+    size_t malformed = 0;
+    for (const auto& event_with_id : events) {
+      size_t pos = event_with_id.find('|');
+      if (pos != std::string::npos) {
+        event_ids.push_back(event_with_id.substr(0, pos));
+        event_jsons.push_back(event_with_id.substr(pos + 1));
+      } else {
+        malformed++;
+      }
+    }
+
+    if (malformed > 0) {
+      // Without an id the row can't be sent or removed on its own. Once the
+      // good rows are deleted it is the only one left under this lease.
+      PostHogLogger::Error("Dropping " + std::to_string(malformed) + " malformed queued events");
+      PostHogMetrics::Increment("flush.malformed_events", static_cast<int64_t>(malformed));
+      if (event_ids.empty()) {
+        if (!storage_manager_->RemoveLeasedEvents(lease_id)) {
+          storage_manager_->ReleaseLease(lease_id);
+          return false;
+        }
+        continue;
+      }
+    }
+
+    HttpResponse response = http_client_->PostCapture(event_jsons);
+    if (!response.success) {
+      PostHogLogger::Error("Failed to send " + std::to_string(event_jsons.size()) + " events: HTTP " + std::to_string(response.status_code));
+      storage_manager_->ReleaseLease(lease_id);
+      PostHogMetrics::Increment("flush.failed_batches");
+      return false;
+    }
+
+    RememberSent(event_ids);
+    if (!storage_manager_->RemoveEvents(event_ids)) {
+      // Rows stay queued and will be uploaded again; the duplicate is counted then
+      storage_manager_->ReleaseLease(lease_id);
+      PostHogLogger::Error("Failed to remove " + std::to_string(event_ids.size()) + " sent events");
+      return false;
+    }
+    if (malformed > 0 && !storage_manager_->RemoveLeasedEvents(lease_id)) {
+      // Leave them sendable rather than leased forever; the next drain retries
+      storage_manager_->ReleaseLease(lease_id);
+    }
+    sent_count_.fetch_add(event_ids.size(), std::memory_order_relaxed);
+    PostHogMetrics::Increment("flush.events_sent", static_cast<int64_t>(event_ids.size()));
+  }
+  return false;
+}
+
+void FlushCoordinator::RememberSent(const std::vector<std::string>& event_ids) {
+  // Only the draining thread gets here, so no extra locking is needed
+  for (const auto& id : event_ids) {
+    if (!recent_sent_.insert(id).second) {
+      duplicate_count_.fetch_add(1, std::memory_order_relaxed);
+      PostHogMetrics::Increment("flush.duplicate_sends");
+      continue;
+    }
+    recent_sent_order_.push_back(id);
+    if (recent_sent_order_.size() > kRecentSentCapacity) {
+      recent_sent_.erase(recent_sent_order_.front());
+      recent_sent_order_.pop_front();
+    }
+  }
+}
@@ -0,0 +1,61 @@
+#ifndef FLUSH_COORDINATOR_H_
+#define FLUSH_COORDINATOR_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+class StorageManager;
+class HttpClient;
+
+// Single entry point for uploading queued events. Concurrent Flush() calls
+// (flush thread, flush_at, the flush method) are merged into one drain: the
+// first caller runs it and later callers wait for a drain that started after
+// their request. Rows are leased while in flight so each one is sent at most
+// once per attempt.
+class FlushCoordinator {
+ public:
+  FlushCoordinator(StorageManager* storage_manager, HttpClient* http_client, int max_batch_size);
+
+  // Upload everything queued at the time of the call. Returns false if a batch failed.
+  bool Flush();
+
+  // Abort the running drain after its current batch (used on shutdown)
+  void Cancel();
+
+  uint64_t GetSentCount() const { return sent_count_.load(std::memory_order_relaxed); }
+  uint64_t GetDuplicateSendCount() const { return duplicate_count_.load(std::memory_order_relaxed); }
+  // Drains that failed in a row since the last successful one (0 when uploads work)
+  int GetConsecutiveFailures() const { return consecutive_failures_.load(std::memory_order_relaxed); }
+
+ private:
+  bool Drain();
+  void RememberSent(const std::vector<std::string>& event_ids);
+
+  StorageManager* storage_manager_;
+  HttpClient* http_client_;
+  int max_batch_size_;
+
+  std::mutex mutex_;
+  std::condition_variable done_cv_;
+  bool draining_;
+  uint64_t requested_generation_;
+  uint64_t completed_generation_;
+  bool last_result_;
+  std::atomic<bool> cancelled_;
+
+  // Recently uploaded row IDs, used to detect rows that get sent twice
+  std::unordered_set<std::string> recent_sent_;
+  std::deque<std::string> recent_sent_order_;
+
+  std::atomic<uint64_t> sent_count_;
+  std::atomic<uint64_t> duplicate_count_;
+  std::atomic<int> consecutive_failures_;
+};
+
+#endif  // FLUSH_COORDINATOR_H_
@@ -5,6 +5,7 @@
 #include <sstream>
 #include <iostream>
 #include <cstring>
+#include <strings.h>
 
 using json = nlohmann::json;
 
@@ -13,6 +14,31 @@ static size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* use
   return size * nmemb;
 }
 
+// Captures the ETag header (case-insensitive) from the final response
+static size_t HeaderCallback(char* buffer, size_t size, size_t nitems, void* userdata) {
+  size_t length = size * nitems;
+  if (length >= 5 && strncmp(buffer, "HTTP/", 5) == 0) {
+    // Status line of a new response (e.g. after a redirect)
+    static_cast<std::string*>(userdata)->clear();
+    return length;
+  }
+  static const char kEtag[] = "etag:";
+  const size_t prefix_length = sizeof(kEtag) - 1;
+  if (length > prefix_length && strncasecmp(buffer, kEtag, prefix_length) == 0) {
+    std::string value(buffer + prefix_length, length - prefix_length);
+    value.erase(0, value.find_first_not_of(" \t"));
+    value.erase(value.find_last_not_of(" \t\r\n") + 1);
+    *static_cast<std::string*>(userdata) = value;
+  }
+  return length;
+}
+
+// Polled by curl during the transfer (at least once a second, even while
+// connecting or stalled); a non-zero return aborts it
+static int CancelCallback(void* clientp, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+  return static_cast<const std::atomic<bool>*>(clientp)->load() ? 1 : 0;
+}
+
 HttpClient::HttpClient() : debug_(false), curl_handle_(nullptr) {}
 
 HttpClient::~HttpClient() {
@@ -62,7 +88,15 @@ void HttpClient::SetDebug(bool debug) {
   }
 }
 
-HttpResponse HttpClient::PerformPost(const std::string& endpoint, const std::string& body) {
+HttpResponse HttpClient::PerformPost(const std::string& endpoint, const std::string& body,
+                                     const std::vector<std::string>& extra_headers,
+                                     const std::atomic<bool>* cancelled) {
+  return PerformRequest(endpoint, &body, extra_headers, cancelled);
+}
+
+HttpResponse HttpClient::PerformRequest(const std::string& endpoint, const std::string* body,
+                                        const std::vector<std::string>& extra_headers,
+                                        const std::atomic<bool>* cancelled) {
   HttpResponse response;
   response.success = false;
   response.status_code = 0;
@@ -71,7 +105,8 @@ HttpResponse HttpClient::PerformPost(const std::string& endpoint, const std::str
   // Multiple threads (flush thread, session replay thread) can call this simultaneously
   std::lock_guard<std::mutex> lock(curl_mutex_);
 
-  if (!curl_handle_ || base_url_.empty()) {
+  // May have been cancelled while waiting for the handle
+  if (!curl_handle_ || base_url_.empty() || (cancelled && cancelled->load())) {
     return response;
   }
 
@@ -80,6 +115,9 @@ HttpResponse HttpClient::PerformPost(const std::string& endpoint, const std::str
 
   struct curl_slist* headers = nullptr;
   headers = curl_slist_append(headers, "Content-Type: application/json");
+  for (const auto& header : extra_headers) {
+    headers = curl_slist_append(headers, header.c_str());
+  }
 
   // Reset curl handle state before reuse
   curl_easy_reset(static_cast<CURL*>(curl_handle_));
@@ -93,9 +131,20 @@ HttpResponse HttpClient::PerformPost(const std::string& endpoint, const std::str
   curl_easy_setopt(static_cast<CURL*>(curl_handle_), CURLOPT_VERBOSE, 0L);
 
   curl_easy_setopt(static_cast<CURL*>(curl_handle_), CURLOPT_URL, url.c_str());
-  curl_easy_setopt(static_cast<CURL*>(curl_handle_), CURLOPT_POSTFIELDS, body.c_str());
+  if (body) {
+    curl_easy_setopt(static_cast<CURL*>(curl_handle_), CURLOPT_POSTFIELDS, body->c_str());
+  } else {
+    curl_easy_setopt(static_cast<CURL*>(curl_handle_), CURLOPT_HTTPGET, 1L);
+  }
   curl_easy_setopt(static_cast<CURL*>(curl_handle_), CURLOPT_HTTPHEADER, headers);
   curl_easy_setopt(static_cast<CURL*>(curl_handle_), CURLOPT_WRITEDATA, &response_body);
+  curl_easy_setopt(static_cast<CURL*>(curl_handle_), CURLOPT_HEADERFUNCTION, HeaderCallback);
+  curl_easy_setopt(static_cast<CURL*>(curl_handle_), CURLOPT_HEADERDATA, &response.etag);
+  if (cancelled) {
+    curl_easy_setopt(static_cast<CURL*>(curl_handle_), CURLOPT_XFERINFOFUNCTION, CancelCallback);
+    curl_easy_setopt(static_cast<CURL*>(curl_handle_), CURLOPT_XFERINFODATA, cancelled);
+    curl_easy_setopt(static_cast<CURL*>(curl_handle_), CURLOPT_NOPROGRESS, 0L);
+  }
 
   CURLcode res = curl_easy_perform(static_cast<CURL*>(curl_handle_));
 
@@ -103,6 +152,8 @@ HttpResponse HttpClient::PerformPost(const std::string& endpoint, const std::str
     curl_easy_getinfo(static_cast<CURL*>(curl_handle_), CURLINFO_RESPONSE_CODE, &response.status_code);
     response.body = response_body;
     response.success = (response.status_code >= 200 && response.status_code < 300);
+  } else if (res == CURLE_ABORTED_BY_CALLBACK) {
+    PostHogLogger::Debug("HTTP request cancelled");
   } else {
     PostHogLogger::Error("HTTP request failed: " + std::string(curl_easy_strerror(res)));
   }
@@ -120,6 +171,9 @@ std::string HttpClient::BuildCapturePayload(const std::vector<std::string>& even
     try {
       json event_json = json::parse(event_str);
       posthog::PostHogEvent event;
+      if (event_json.contains("uuid") && event_json["uuid"].is_string()) {
+        event.uuid = event_json["uuid"].get<std::string>();
+      }
       event.event = event_json["event"].get<std::string>();
       event.distinct_id = event_json["distinct_id"].get<std::string>();
       // Timestamp might be string or number
@@ -147,10 +201,12 @@ std::string HttpClient::BuildCapturePayload(const std::vector<std::string>& even
 }
 
 std::string HttpClient::BuildDecidePayload(const std::string& distinct_id,
-                                           const std::map<std::string, std::string>& properties) {
+                                           const std::map<std::string, std::string>& properties,
+                                           const std::vector<std::string>& flag_keys) {
   posthog::PostHogDecidePayload payload;
   payload.api_key = api_key_;
   payload.distinct_id = distinct_id;
+  payload.flag_keys_to_evaluate = flag_keys;
   
   // Convert map to JSON object
   for (const auto& pair : properties) {
@@ -185,10 +241,25 @@ HttpResponse HttpClient::PostCapture(const std::vector<std::string>& events) {
 }
 
 HttpResponse HttpClient::PostDecide(const std::string& distinct_id,
-                                    const std::map<std::string, std::string>& properties) {
-  std::string payload = BuildDecidePayload(distinct_id, properties);
+                                    const std::map<std::string, std::string>& properties,
+                                    const std::vector<std::string>& flag_keys,
+                                    const std::string& etag,
+                                    const std::atomic<bool>* cancelled) {
+  std::string payload = BuildDecidePayload(distinct_id, properties, flag_keys);
   PostHogLogger::Debug("Fetching feature flags for distinct_id: " + distinct_id);
-  return PerformPost("/decide/", payload);
+  
+  std::vector<std::string> headers;
+  if (!etag.empty()) {
+    headers.push_back("If-None-Match: " + etag);
+  }
+  return PerformPost("/flags/?v=2", payload, headers, cancelled);
+}
+
+HttpResponse HttpClient::GetLocalEvaluation(const std::string& secure_api_key,
+                                            const std::atomic<bool>* cancelled) {
+  PostHogLogger::Debug("Fetching feature flag definitions for local evaluation");
+  std::vector<std::string> headers = {"Authorization: Bearer " + secure_api_key};
+  return PerformRequest("/api/feature_flag/local_evaluation/?token=" + api_key_, nullptr, headers, cancelled);
 }
 
 HttpResponse HttpClient::PostSessionReplay(const std::string& payload) {
@@ -1,6 +1,7 @@
 #ifndef HTTP_CLIENT_H_
 #define HTTP_CLIENT_H_
 
+#include <atomic>
 #include <string>
 #include <vector>
 #include <map>
@@ -11,6 +12,7 @@ struct HttpResponse {
   int status_code = 0;
   std::string body = "";
   bool success = false;
+  std::string etag = "";  // ETag response header, if the server sent one
 };
 
 class HttpClient {
@@ -26,9 +28,19 @@ class HttpClient {
   // Send a batch of events to /capture/
   HttpResponse PostCapture(const std::vector<std::string>& events);
 
-  // Fetch feature flags from /decide/
+  // Fetch feature flags from /flags/. Only flag_keys are evaluated when it is
+  // non-empty. With an etag the request is conditional and may return 304.
+  // Setting *cancelled aborts the request, even mid-transfer.
   HttpResponse PostDecide(const std::string& distinct_id, 
-                          const std::map<std::string, std::string>& properties);
+                          const std::map<std::string, std::string>& properties,
+                          const std::vector<std::string>& flag_keys = {},
+                          const std::string& etag = "",
+                          const std::atomic<bool>* cancelled = nullptr);
+
+  // Download flag definitions for local evaluation (needs a feature flags
+  // secure API key)
+  HttpResponse GetLocalEvaluation(const std::string& secure_api_key,
+                                  const std::atomic<bool>* cancelled = nullptr);
 
   // Send session replay data to /capture/
   HttpResponse PostSessionReplay(const std::string& payload);
@@ -40,10 +52,17 @@ class HttpClient {
   void* curl_handle_;
   std::mutex curl_mutex_;  // CRITICAL: Protect curl handle from concurrent access
 
-  HttpResponse PerformPost(const std::string& endpoint, const std::string& body);
+  HttpResponse PerformPost(const std::string& endpoint, const std::string& body,
+                           const std::vector<std::string>& extra_headers = {},
+                           const std::atomic<bool>* cancelled = nullptr);
+  // GET when body is nullptr, POST otherwise
+  HttpResponse PerformRequest(const std::string& endpoint, const std::string* body,
+                              const std::vector<std::string>& extra_headers,
+                              const std::atomic<bool>* cancelled = nullptr);
   std::string BuildCapturePayload(const std::vector<std::string>& events);
   std::string BuildDecidePayload(const std::string& distinct_id,
-                                 const std::map<std::string, std::string>& properties);
+                                 const std::map<std::string, std::string>& properties,
+                                 const std::vector<std::string>& flag_keys);
 };
 
 #endif  // HTTP_CLIENT_H_
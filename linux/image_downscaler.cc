@@ -0,0 +1,165 @@
+#include "image_downscaler.h"
+
+#include <algorithm>
+#include <cmath>
+
+ImageDownscaler::ImageDownscaler(int src_width, int src_height, int dst_width, int dst_height)
+    : src_width_(src_width),
+      src_height_(src_height),
+      dst_width_(std::max(1, std::min(dst_width, src_width))),
+      dst_height_(std::max(1, std::min(dst_height, src_height))),
+      src_row_(0),
+      dst_row_(0),
+      x_taps_(1) {
+  y_spans_ = BuildSpans(src_height_, dst_height_);
+
+  // Regroup the per-source-column spans into per-destination-column taps
+  std::vector<Span> x_spans = BuildSpans(src_width_, dst_width_);
+  x_start_.assign(dst_width_, -1);
+  std::vector<std::vector<uint16_t>> taps(dst_width_);
+  for (int x = 0; x < src_width_; x++) {
+    const Span& span = x_spans[x];
+    if (x_start_[span.first] < 0) {
+      x_start_[span.first] = x;
+    }
+    taps[span.first].push_back(span.weight0);
+    if (span.weight1) {
+      x_start_[span.first + 1] = x;
+      taps[span.first + 1].push_back(span.weight1);
+    }
+  }
+  // Pad every column to the same tap count so the inner loop has a fixed trip
+  // count. Windows near the right edge are shifted left to stay in bounds,
+  // with zero weights on the extra columns.
+  for (const auto& column : taps) {
+    x_taps_ = std::max(x_taps_, static_cast<int>(column.size()));
+  }
+  x_weights_.assign(static_cast<size_t>(dst_width_) * x_taps_, 0);
+  for (int j = 0; j < dst_width_; j++) {
+    int start = std::min(x_start_[j], src_width_ - x_taps_);
+    int shift = x_start_[j] - start;
+    for (size_t k = 0; k < taps[j].size(); k++) {
+      x_weights_[static_cast<size_t>(j) * x_taps_ + shift + k] = taps[j][k];
+    }
+    x_start_[j] = start;
+  }
+
+  current_sums_.assign(static_cast<size_t>(src_width_) * 4, 0);
+  next_sums_.assign(static_cast<size_t>(src_width_) * 4, 0);
+  output_.resize(static_cast<size_t>(dst_width_) * dst_height_ * 4);
+}
+
+std::vector<ImageDownscaler::Span> ImageDownscaler::BuildSpans(int src, int dst) {
+  // Source pixel i covers [edge(i), edge(i+1)) in 1/256ths of a destination
+  // pixel. The edges partition [0, dst*256), so every destination pixel
+  // collects exactly 256 and no source pixel spans more than two of them.
+  // Past 256:1 some source pixels round to zero width; those still get a
+  // (zero-weight) span so each destination pixel's taps stay contiguous, and
+  // the ones that land on the far edge are clamped into the last pixel.
+  auto edge = [src, dst](int i) {
+    return static_cast<uint32_t>((static_cast<uint64_t>(i) * dst * 256 + src / 2) / src);
+  };
+  std::vector<Span> spans(src);
+  for (int i = 0; i < src; i++) {
+    uint32_t begin = edge(i);
+    uint32_t end = edge(i + 1);
+    int first = std::min(static_cast<int>(begin / 256), dst - 1);
+    uint32_t boundary = static_cast<uint32_t>(first + 1) * 256;
+    if (end <= boundary) {
+      spans[i] = {first, static_cast<uint16_t>(end - begin), 0};
+    } else {
+      spans[i] = {first, static_cast<uint16_t>(boundary - begin), static_cast<uint16_t>(end - boundary)};
+    }
+  }
+  return spans;
+}
+
+void ImageDownscaler::AddRow(const uint8_t* rgba_row) {
+  if (src_row_ >= src_height_) {
+    return;
+  }
+
+  // Vertical pass: fold the row into the destination row(s) it overlaps.
+  // Sums stay within 16 bits since each destination row's weights total 256.
+  const Span& span = y_spans_[src_row_];
+  size_t count = current_sums_.size();
+  uint16_t* current = current_sums_.data();
+  uint16_t weight0 = span.weight0;
+  for (size_t i = 0; i < count; i++) {
+    current[i] = static_cast<uint16_t>(current[i] + weight0 * rgba_row[i]);
+  }
+  if (span.weight1) {
+    uint16_t* next = next_sums_.data();
+    uint16_t weight1 = span.weight1;
+    for (size_t i = 0; i < count; i++) {
+      next[i] = static_cast<uint16_t>(next[i] + weight1 * rgba_row[i]);
+    }
+  }
+
+  src_row_++;
+  if (src_row_ == src_height_ || y_spans_[src_row_].first != dst_row_) {
+    EmitRow();
+  }
+}
+
+// Weighted sum of `taps` neighbouring columns for each destination pixel.
+// Instantiated for the common tap counts so the inner loop fully unrolls.
+template <int kTaps>
+static void FilterRow(const uint16_t* sums, const int* starts, const uint16_t* weights,
+                      int taps, int dst_width, uint8_t* out) {
+  const int count = kTaps > 0 ? kTaps : taps;
+  for (int j = 0; j < dst_width; j++) {
+    const uint16_t* src = sums + static_cast<size_t>(starts[j]) * 4;
+    const uint16_t* w = weights + static_cast<size_t>(j) * count;
+    uint32_t r = 0, g = 0, b = 0, a = 0;
+    for (int k = 0; k < count; k++) {
+      uint32_t weight = w[k];
+      r += weight * src[k * 4];
+      g += weight * src[k * 4 + 1];
+      b += weight * src[k * 4 + 2];
+      a += weight * src[k * 4 + 3];
+    }
+    out[j * 4] = static_cast<uint8_t>((r + 32768) >> 16);
+    out[j * 4 + 1] = static_cast<uint8_t>((g + 32768) >> 16);
+    out[j * 4 + 2] = static_cast<uint8_t>((b + 32768) >> 16);
+    out[j * 4 + 3] = static_cast<uint8_t>((a + 32768) >> 16);
+  }
+}
+
+void ImageDownscaler::EmitRow() {
+  // Horizontal pass over the finished column sums; total weight is 256 * 256
+  uint8_t* out = output_.data() + static_cast<size_t>(dst_row_) * dst_width_ * 4;
+  const uint16_t* sums = current_sums_.data();
+  switch (x_taps_) {
+    case 2:
+      FilterRow<2>(sums, x_start_.data(), x_weights_.data(), x_taps_, dst_width_, out);
+      break;
+    case 3:
+      FilterRow<3>(sums, x_start_.data(), x_weights_.data(), x_taps_, dst_width_, out);
+      break;
+    case 4:
+      FilterRow<4>(sums, x_start_.data(), x_weights_.data(), x_taps_, dst_width_, out);
+      break;
+    default:
+      FilterRow<0>(sums, x_start_.data(), x_weights_.data(), x_taps_, dst_width_, out);
+      break;
+  }
+
+  current_sums_.swap(next_sums_);
+  std::fill(next_sums_.begin(), next_sums_.end(), 0);
+  dst_row_++;
+}
+
+bool ImageDownscaler::FitWithin(int width, int height, int max_dimension, int& out_width, int& out_height) {
+  out_width = width;
+  out_height = height;
+  if (max_dimension <= 0 || (width <= max_dimension && height <= max_dimension)) {
+    return false;
+  }
+
+  double scale = std::min(static_cast<double>(max_dimension) / width,
+                          static_cast<double>(max_dimension) / height);
+  out_width = std::max(1, static_cast<int>(std::lround(width * scale)));
+  out_height = std::max(1, static_cast<int>(std::lround(height * scale)));
+  return true;
+}
@@ -0,0 +1,70 @@
+#ifndef IMAGE_DOWNSCALER_H_
+#define IMAGE_DOWNSCALER_H_
+
+#include <cstdint>
+#include <vector>
+
+// Area-averaging (box filter) downscaler for RGBA images.
+//
+// Source rows are pushed one at a time, top to bottom, so a decoder can feed
+// it while reading and the full-resolution image never has to exist in
+// memory. Each destination pixel is the coverage-weighted mean of the source
+// pixels under it (weights in 1/256 steps), which handles non-integer ratios
+// without the aliasing of nearest-neighbour sampling.
+//
+// Rows are first folded vertically into 16-bit column sums, one multiply-add
+// per byte that compilers vectorize; the horizontal pass then runs once per
+// destination row rather than once per source row. Only downscaling is
+// supported.
+class ImageDownscaler {
+ public:
+  ImageDownscaler(int src_width, int src_height, int dst_width, int dst_height);
+
+  // Push the next source row (src_width RGBA pixels)
+  void AddRow(const uint8_t* rgba_row);
+
+  // True once every source row has been pushed
+  bool IsComplete() const { return src_row_ == src_height_; }
+
+  // Destination pixels, RGBA with rows dst_width * 4 bytes apart
+  const std::vector<uint8_t>& GetOutput() const { return output_; }
+  std::vector<uint8_t>& GetOutput() { return output_; }
+
+  // Largest size that keeps the aspect ratio with neither side above
+  // max_dimension. Returns false when no downscaling is needed.
+  static bool FitWithin(int width, int height, int max_dimension, int& out_width, int& out_height);
+
+ private:
+  // How one source row splits between destination rows: weight0 goes to
+  // `first`, weight1 to `first + 1`. Each destination row receives 256 total.
+  struct Span {
+    int first;
+    uint16_t weight0;
+    uint16_t weight1;
+  };
+
+  static std::vector<Span> BuildSpans(int src, int dst);
+  void EmitRow();
+
+  int src_width_;
+  int src_height_;
+  int dst_width_;
+  int dst_height_;
+  int src_row_;
+  int dst_row_;
+
+  std::vector<Span> y_spans_;
+
+  // Horizontal taps: destination column j reads x_taps_ source columns
+  // starting at x_start_[j], weighted by x_weights_[j * x_taps_ + k]
+  int x_taps_;
+  std::vector<int> x_start_;
+  std::vector<uint16_t> x_weights_;
+
+  // Weighted column sums for the destination row being built and the next
+  std::vector<uint16_t> current_sums_;
+  std::vector<uint16_t> next_sums_;
+  std::vector<uint8_t> output_;
+};
+
+#endif  // IMAGE_DOWNSCALER_H_
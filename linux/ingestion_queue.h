@@ -0,0 +1,106 @@
+#ifndef INGESTION_QUEUE_H_
+#define INGESTION_QUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Bounded multi-producer/single-consumer ring buffer of serialized events.
+//
+// Producers (method-channel handlers on the platform thread, plus any worker
+// that captures events) claim a slot with a single CAS and never take a lock.
+// The persistence worker is the only consumer. Based on Dmitry Vyukov's
+// bounded MPMC queue: each cell carries a sequence number that tells producers
+// and the consumer whether the cell is free or holds a published item.
+class IngestionQueue {
+ public:
+  // Capacity is rounded up to the next power of two (minimum 2).
+  explicit IngestionQueue(size_t capacity)
+      : capacity_(RoundUpToPowerOfTwo(capacity)),
+        mask_(capacity_ - 1),
+        cells_(new Cell[capacity_]),
+        enqueue_pos_(0),
+        dequeue_pos_(0) {
+    for (size_t i = 0; i < capacity_; i++) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  IngestionQueue(const IngestionQueue&) = delete;
+  IngestionQueue& operator=(const IngestionQueue&) = delete;
+
+  // Returns false if the ring is full; the item is left untouched in that case.
+  bool TryPush(std::string& item) {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    Cell* cell;
+    for (;;) {
+      cell = &cells_[pos & mask_];
+      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    cell->data = std::move(item);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Must only be called from the single consumer thread.
+  bool TryPop(std::string& item) {
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    Cell* cell = &cells_[pos & mask_];
+    size_t seq = cell->sequence.load(std::memory_order_acquire);
+    if (static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1) != 0) {
+      return false;
+    }
+    dequeue_pos_.store(pos + 1, std::memory_order_relaxed);
+    item = std::move(cell->data);
+    cell->data.clear();
+    cell->sequence.store(pos + capacity_, std::memory_order_release);
+    return true;
+  }
+
+  // Approximate number of queued items (exact when producers are quiescent).
+  size_t SizeApprox() const {
+    size_t enqueued = enqueue_pos_.load(std::memory_order_relaxed);
+    size_t dequeued = dequeue_pos_.load(std::memory_order_relaxed);
+    return enqueued > dequeued ? enqueued - dequeued : 0;
+  }
+
+  size_t Capacity() const { return capacity_; }
+
+ private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    std::string data;
+  };
+
+  static size_t RoundUpToPowerOfTwo(size_t value) {
+    // Stops at the top bit instead of shifting to 0 and looping forever
+    const size_t max_result = ~(~static_cast<size_t>(0) >> 1);
+    size_t result = 2;
+    while (result < value && result < max_result) {
+      result <<= 1;
+    }
+    return result;
+  }
+
+  const size_t capacity_;
+  const size_t mask_;
+  std::unique_ptr<Cell[]> cells_;
+
+  // Keep producer and consumer cursors on separate cache lines
+  alignas(64) std::atomic<size_t> enqueue_pos_;
+  alignas(64) std::atomic<size_t> dequeue_pos_;
+};
+
+#endif  // INGESTION_QUEUE_H_
@@ -0,0 +1,189 @@
+#include "jpeg_encoder.h"
+#include "posthog_logger.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+
+#if defined(HAVE_TURBOJPEG)
+#include <turbojpeg.h>
+#elif defined(HAVE_JPEG)
+#include <cstdio>
+#include <jpeglib.h>
+#include <setjmp.h>
+#endif
+
+namespace {
+
+#if defined(HAVE_TURBOJPEG)
+
+// One compressor per thread: TurboJPEG handles are not thread-safe, and
+// creating one per frame re-allocates all of the codec's internal state.
+struct TurboCompressor {
+  tjhandle handle = nullptr;
+  unsigned char* buffer = nullptr;
+  unsigned long capacity = 0;
+
+  TurboCompressor() : handle(tjInitCompress()) {}
+  ~TurboCompressor() {
+    if (buffer) {
+      tjFree(buffer);
+    }
+    if (handle) {
+      tjDestroy(handle);
+    }
+  }
+};
+
+bool EncodeWithTurboJpeg(const uint8_t* pixels, int width, int height, int stride,
+                         int quality, std::vector<uint8_t>& jpeg_data) {
+  thread_local TurboCompressor compressor;
+  if (!compressor.handle) {
+    PostHogLogger::Error("[Replay] Failed to create TurboJPEG compressor");
+    return false;
+  }
+
+  // Size the output for the worst case once so TurboJPEG never reallocates
+  unsigned long needed = tjBufSize(width, height, TJSAMP_420);
+  if (compressor.capacity < needed) {
+    if (compressor.buffer) {
+      tjFree(compressor.buffer);
+    }
+    compressor.buffer = tjAlloc(static_cast<int>(needed));
+    compressor.capacity = compressor.buffer ? needed : 0;
+    if (!compressor.buffer) {
+      return false;
+    }
+  }
+
+  unsigned long jpeg_size = compressor.capacity;
+  if (tjCompress2(compressor.handle, pixels, width, stride, height, TJPF_RGBA,
+                  &compressor.buffer, &jpeg_size, TJSAMP_420, quality, TJFLAG_NOREALLOC) != 0) {
+    PostHogLogger::Error("[Replay] TurboJPEG encode failed: "
+                         + std::string(tjGetErrorStr2(compressor.handle)));
+    return false;
+  }
+
+  jpeg_data.assign(compressor.buffer, compressor.buffer + jpeg_size);
+  return true;
+}
+
+#elif defined(HAVE_JPEG)
+
+void jpeg_error_exit(j_common_ptr cinfo) {
+  (*cinfo->err->output_message)(cinfo);
+  longjmp(*static_cast<jmp_buf*>(cinfo->client_data), 1);
+}
+
+// Long-lived libjpeg compressor and output buffer for the calling thread
+struct ClassicCompressor {
+  jpeg_compress_struct cinfo;
+  jpeg_error_mgr jerr;
+  jmp_buf jump;
+  unsigned char* buffer = nullptr;
+  unsigned long capacity = 0;
+  std::vector<uint8_t> rgb_row;
+
+  ClassicCompressor() {
+    cinfo.err = jpeg_std_error(&jerr);
+    jerr.error_exit = jpeg_error_exit;
+    cinfo.client_data = &jump;
+    jpeg_create_compress(&cinfo);
+  }
+  ~ClassicCompressor() {
+    jpeg_destroy_compress(&cinfo);
+    free(buffer);
+  }
+};
+
+bool EncodeWithLibjpeg(const uint8_t* pixels, int width, int height, int stride,
+                       int quality, std::vector<uint8_t>& jpeg_data) {
+  thread_local ClassicCompressor compressor;
+  jpeg_compress_struct& cinfo = compressor.cinfo;
+
+  // Screen content at replay qualities stays well under half a byte per pixel
+  unsigned long wanted = std::max<unsigned long>(static_cast<unsigned long>(width) * height / 2, 64 * 1024);
+  if (compressor.capacity < wanted) {
+    free(compressor.buffer);
+    compressor.buffer = static_cast<unsigned char*>(malloc(wanted));
+    compressor.capacity = compressor.buffer ? wanted : 0;
+  }
+
+  if (setjmp(compressor.jump)) {
+    jpeg_abort_compress(&cinfo);
+    return false;
+  }
+
+  // libjpeg only allocates if the frame outgrows the buffer we hand it
+  unsigned char* outbuffer = compressor.buffer;
+  unsigned long outsize = compressor.capacity;
+  jpeg_mem_dest(&cinfo, &outbuffer, &outsize);
+
+  cinfo.image_width = width;
+  cinfo.image_height = height;
+#ifdef JCS_EXTENSIONS
+  cinfo.input_components = 4;
+  cinfo.in_color_space = JCS_EXT_RGBA;
+#else
+  cinfo.input_components = 3;
+  cinfo.in_color_space = JCS_RGB;
+  compressor.rgb_row.resize(static_cast<size_t>(width) * 3);
+#endif
+  jpeg_set_defaults(&cinfo);
+  jpeg_set_quality(&cinfo, quality, TRUE);
+  jpeg_start_compress(&cinfo, TRUE);
+
+  while (cinfo.next_scanline < cinfo.image_height) {
+    const uint8_t* src = pixels + static_cast<size_t>(cinfo.next_scanline) * stride;
+#ifdef JCS_EXTENSIONS
+    JSAMPROW row = const_cast<JSAMPROW>(src);
+#else
+    uint8_t* dst = compressor.rgb_row.data();
+    for (int x = 0; x < width; x++) {
+      dst[x * 3] = src[x * 4];
+      dst[x * 3 + 1] = src[x * 4 + 1];
+      dst[x * 3 + 2] = src[x * 4 + 2];
+    }
+    JSAMPROW row = dst;
+#endif
+    jpeg_write_scanlines(&cinfo, &row, 1);
+  }
+
+  jpeg_finish_compress(&cinfo);
+
+  if (outbuffer != compressor.buffer) {
+    // libjpeg grew the buffer; keep its allocation for the next frame
+    free(compressor.buffer);
+    compressor.buffer = outbuffer;
+    compressor.capacity = outsize;
+  }
+
+  jpeg_data.assign(outbuffer, outbuffer + outsize);
+  return true;
+}
+
+#endif
+
+}  // namespace
+
+bool JpegEncoder::IsAvailable() {
+#if defined(HAVE_TURBOJPEG) || defined(HAVE_JPEG)
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool JpegEncoder::EncodeRgba(const uint8_t* pixels, int width, int height, int stride,
+                             int quality, std::vector<uint8_t>& jpeg_data) {
+  if (!pixels || width <= 0 || height <= 0 || stride < width * 4) {
+    return false;
+  }
+#if defined(HAVE_TURBOJPEG)
+  return EncodeWithTurboJpeg(pixels, width, height, stride, quality, jpeg_data);
+#elif defined(HAVE_JPEG)
+  return EncodeWithLibjpeg(pixels, width, height, stride, quality, jpeg_data);
+#else
+  return false;
+#endif
+}
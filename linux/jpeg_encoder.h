@@ -0,0 +1,25 @@
+#ifndef JPEG_ENCODER_H_
+#define JPEG_ENCODER_H_
+
+#include <cstdint>
+#include <vector>
+
+// JPEG encoding for session replay frames.
+//
+// Built with HAVE_TURBOJPEG, frames go through libjpeg-turbo's TurboJPEG API
+// with TJPF_RGBA input. Otherwise, with HAVE_JPEG, the classic libjpeg API is
+// used (fed RGBA directly when libjpeg-turbo's colorspace extensions exist).
+// Each calling thread keeps one long-lived compressor and output buffer, so
+// workers on the replay encode pool reuse them from frame to frame.
+class JpegEncoder {
+ public:
+  // Whether this build can produce JPEG at all
+  static bool IsAvailable();
+
+  // Encode 8-bit RGBA pixels whose rows are `stride` bytes apart. Alpha is
+  // ignored. Returns false if the encoder is unavailable or fails.
+  static bool EncodeRgba(const uint8_t* pixels, int width, int height, int stride,
+                         int quality, std::vector<uint8_t>& jpeg_data);
+};
+
+#endif  // JPEG_ENCODER_H_
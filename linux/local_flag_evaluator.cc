@@ -0,0 +1,320 @@
+#include "local_flag_evaluator.h"
+#include "posthog_logger.h"
+#include <glib.h>
+#include <algorithm>
+#include <cctype>
+
+namespace {
+  // 15 hex digits of SHA1, as in PostHog's server-side SDKs
+  const double kLongScale = static_cast<double>(0xFFFFFFFFFFFFFFFULL);
+
+  // Reused per thread so hashing doesn't allocate on every evaluation
+  struct ThreadChecksum {
+    GChecksum* checksum = g_checksum_new(G_CHECKSUM_SHA1);
+    ~ThreadChecksum() { g_checksum_free(checksum); }
+  };
+
+  // Python-style str() of a property value, lowercased for case-insensitive compares
+  std::string ToLowerString(const json& value) {
+    std::string result = value.is_string() ? value.get<std::string>() : value.dump();
+    std::transform(result.begin(), result.end(), result.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return result;
+  }
+
+  std::string ToString(const json& value) {
+    return value.is_string() ? value.get<std::string>() : value.dump();
+  }
+
+  bool ParseNumber(const json& value, double* number) {
+    if (value.is_number()) {
+      *number = value.get<double>();
+      return true;
+    }
+    if (value.is_string()) {
+      const std::string& text = value.get_ref<const std::string&>();
+      char* end = nullptr;
+      *number = strtod(text.c_str(), &end);
+      return !text.empty() && end && *end == '\0';
+    }
+    return false;
+  }
+
+  template <typename T>
+  bool Compare(const T& lhs, const T& rhs, const std::string& op) {
+    if (op == "gt") return lhs > rhs;
+    if (op == "gte") return lhs >= rhs;
+    if (op == "lt") return lhs < rhs;
+    return lhs <= rhs;
+  }
+
+  std::string PayloadToString(const json& payload) {
+    // Payloads usually arrive JSON-encoded already
+    return payload.is_string() ? payload.get<std::string>() : payload.dump();
+  }
+}
+
+LocalFlagEvaluator::LocalFlagEvaluator() : definitions_(std::make_shared<Definitions>()) {}
+
+bool LocalFlagEvaluator::LoadDefinitions(const std::string& response_json) {
+  json response = json::parse(response_json, nullptr, false);
+  if (response.is_discarded() || !response.contains("flags") || !response["flags"].is_array()) {
+    return false;
+  }
+
+  auto definitions = std::make_shared<Definitions>();
+  for (const auto& flag_json : response["flags"]) {
+    if (!flag_json.is_object() || !flag_json.contains("key") || !flag_json["key"].is_string()) {
+      continue;
+    }
+    if (flag_json.value("deleted", false)) {
+      continue;
+    }
+
+    FlagDefinition flag;
+    flag.key = flag_json["key"].get<std::string>();
+    flag.active = flag_json.value("active", false);
+    flag.needs_server = flag_json.value("ensure_experience_continuity", false);
+
+    const json filters = flag_json.value("filters", json::object());
+    if (filters.contains("aggregation_group_type_index") && !filters["aggregation_group_type_index"].is_null()) {
+      flag.needs_server = true;
+    }
+
+    if (filters.contains("groups") && filters["groups"].is_array()) {
+      for (const auto& group_json : filters["groups"]) {
+        ConditionGroup group;
+        if (group_json.contains("rollout_percentage") && group_json["rollout_percentage"].is_number()) {
+          group.has_rollout = true;
+          group.rollout_percentage = group_json["rollout_percentage"].get<double>();
+        }
+        if (group_json.contains("variant") && group_json["variant"].is_string()) {
+          group.variant = group_json["variant"].get<std::string>();
+        }
+        if (group_json.contains("properties") && group_json["properties"].is_array()) {
+          for (const auto& property_json : group_json["properties"]) {
+            PropertyFilter filter;
+            filter.key = property_json.value("key", "");
+            filter.op = property_json.contains("operator") && property_json["operator"].is_string() ?
+              property_json["operator"].get<std::string>() : "exact";
+            filter.type = property_json.value("type", "person");
+            filter.value = property_json.value("value", json());
+            if (filter.op == "regex" || filter.op == "not_regex") {
+              try {
+                filter.regex = std::make_shared<std::regex>(ToString(filter.value), std::regex::ECMAScript);
+              } catch (const std::regex_error&) {
+                // Invalid patterns never match, as on the server
+              }
+            }
+            group.properties.push_back(std::move(filter));
+          }
+        }
+        flag.groups.push_back(std::move(group));
+      }
+      // Conditions that override the variant are checked first
+      std::stable_sort(flag.groups.begin(), flag.groups.end(),
+                       [](const ConditionGroup& a, const ConditionGroup& b) {
+                         return !a.variant.empty() && b.variant.empty();
+                       });
+    }
+
+    if (filters.contains("multivariate") && filters["multivariate"].is_object() &&
+        filters["multivariate"].contains("variants") && filters["multivariate"]["variants"].is_array()) {
+      for (const auto& variant_json : filters["multivariate"]["variants"]) {
+        Variant variant;
+        variant.key = variant_json.value("key", "");
+        variant.rollout_percentage = variant_json.value("rollout_percentage", 0.0);
+        flag.variants.push_back(std::move(variant));
+      }
+    }
+
+    if (filters.contains("payloads") && filters["payloads"].is_object()) {
+      for (const auto& [payload_key, payload] : filters["payloads"].items()) {
+        if (!payload.is_null()) {
+          flag.payloads[payload_key] = PayloadToString(payload);
+        }
+      }
+    }
+
+    std::string key = flag.key;
+    (*definitions)[key] = std::move(flag);
+  }
+
+  std::atomic_store(&definitions_, std::shared_ptr<const Definitions>(std::move(definitions)));
+  return true;
+}
+
+bool LocalFlagEvaluator::HasDefinitions() const {
+  return !std::atomic_load(&definitions_)->empty();
+}
+
+std::vector<std::string> LocalFlagEvaluator::GetFlagKeys() const {
+  std::shared_ptr<const Definitions> definitions = std::atomic_load(&definitions_);
+  std::vector<std::string> keys;
+  keys.reserve(definitions->size());
+  for (const auto& entry : *definitions) {
+    keys.push_back(entry.first);
+  }
+  return keys;
+}
+
+double LocalFlagEvaluator::Hash(const std::string& key, const std::string& distinct_id, const std::string& salt) {
+  thread_local ThreadChecksum thread_checksum;
+  GChecksum* checksum = thread_checksum.checksum;
+  g_checksum_reset(checksum);
+
+  std::string hash_key = key + "." + distinct_id + salt;
+  g_checksum_update(checksum, reinterpret_cast<const guchar*>(hash_key.data()), hash_key.size());
+
+  guint8 digest[20];
+  gsize digest_length = sizeof(digest);
+  g_checksum_get_digest(checksum, digest, &digest_length);
+
+  // First 15 hex digits == top 60 bits of the digest
+  uint64_t value = 0;
+  for (int i = 0; i < 8; i++) {
+    value = (value << 8) | digest[i];
+  }
+  return static_cast<double>(value >> 4) / kLongScale;
+}
+
+LocalFlagEvaluator::Match LocalFlagEvaluator::MatchProperty(const PropertyFilter& filter, const json& properties) {
+  if (filter.type == "cohort" || !properties.is_object() || !properties.contains(filter.key)) {
+    return Match::kInconclusive;
+  }
+  const std::string& op = filter.op;
+  if (op == "is_not_set") {
+    return Match::kInconclusive;
+  }
+
+  const json& override_value = properties[filter.key];
+  auto result = [](bool matched) { return matched ? Match::kTrue : Match::kFalse; };
+
+  if (op == "exact" || op == "is_not") {
+    std::string actual = ToLowerString(override_value);
+    bool matched = false;
+    if (filter.value.is_array()) {
+      for (const auto& candidate : filter.value) {
+        if (ToLowerString(candidate) == actual) {
+          matched = true;
+          break;
+        }
+      }
+    } else {
+      matched = ToLowerString(filter.value) == actual;
+    }
+    return result(op == "exact" ? matched : !matched);
+  }
+  if (op == "is_set") {
+    return Match::kTrue;
+  }
+  if (op == "icontains" || op == "not_icontains") {
+    bool contains = ToLowerString(override_value).find(ToLowerString(filter.value)) != std::string::npos;
+    return result(op == "icontains" ? contains : !contains);
+  }
+  if (op == "regex" || op == "not_regex") {
+    if (!filter.regex) {
+      return Match::kFalse;
+    }
+    bool found = std::regex_search(ToString(override_value), *filter.regex);
+    return result(op == "regex" ? found : !found);
+  }
+  if (op == "gt" || op == "gte" || op == "lt" || op == "lte") {
+    double expected = 0;
+    double actual = 0;
+    if (ParseNumber(filter.value, &expected) && !override_value.is_null()) {
+      if (!override_value.is_string() && ParseNumber(override_value, &actual)) {
+        return result(Compare(actual, expected, op));
+      }
+    }
+    return result(Compare(ToString(override_value), ToString(filter.value), op));
+  }
+
+  // Date operators and anything newer are left to the server
+  return Match::kInconclusive;
+}
+
+LocalFlagEvaluator::Match LocalFlagEvaluator::MatchCondition(const FlagDefinition& flag, const ConditionGroup& group,
+                                                             const std::string& distinct_id,
+                                                             const json& properties) const {
+  if (!group.properties.empty()) {
+    for (const auto& filter : group.properties) {
+      Match match = MatchProperty(filter, properties);
+      if (match != Match::kTrue) {
+        return match;
+      }
+    }
+    if (!group.has_rollout) {
+      return Match::kTrue;
+    }
+  }
+  if (group.has_rollout && Hash(flag.key, distinct_id) > group.rollout_percentage / 100.0) {
+    return Match::kFalse;
+  }
+  return Match::kTrue;
+}
+
+std::string LocalFlagEvaluator::MatchingVariant(const FlagDefinition& flag, const std::string& distinct_id) const {
+  if (flag.variants.empty()) {
+    return "";
+  }
+  double hash = Hash(flag.key, distinct_id, "variant");
+  double value_min = 0;
+  for (const auto& variant : flag.variants) {
+    double value_max = value_min + variant.rollout_percentage / 100.0;
+    if (hash >= value_min && hash < value_max) {
+      return variant.key;
+    }
+    value_min = value_max;
+  }
+  return "";
+}
+
+bool LocalFlagEvaluator::Evaluate(const std::string& flag_key, const std::string& distinct_id,
+                                  const json& person_properties, posthog::FeatureFlagValue* result) const {
+  std::shared_ptr<const Definitions> definitions = std::atomic_load(&definitions_);
+  auto it = definitions->find(flag_key);
+  if (it == definitions->end()) {
+    return false;
+  }
+  const FlagDefinition& flag = it->second;
+
+  if (!flag.active) {
+    *result = posthog::FeatureFlagValue();
+    return true;
+  }
+  if (flag.needs_server) {
+    return false;
+  }
+
+  bool inconclusive = false;
+  for (const auto& group : flag.groups) {
+    Match match = MatchCondition(flag, group, distinct_id, person_properties);
+    if (match == Match::kInconclusive) {
+      inconclusive = true;
+      continue;
+    }
+    if (match == Match::kFalse) {
+      continue;
+    }
+
+    posthog::FeatureFlagValue value;
+    value.enabled = true;
+    bool valid_override = !group.variant.empty() &&
+        std::any_of(flag.variants.begin(), flag.variants.end(),
+                    [&group](const Variant& variant) { return variant.key == group.variant; });
+    value.variant = valid_override ? group.variant : MatchingVariant(flag, distinct_id);
+    auto payload = flag.payloads.find(value.variant.empty() ? "true" : value.variant);
+    if (payload != flag.payloads.end()) {
+      value.payload_json = payload->second;
+    }
+    *result = std::move(value);
+    return true;
+  }
+
+  if (inconclusive) {
+    return false;
+  }
+  *result = posthog::FeatureFlagValue();
+  return true;
+}
@@ -0,0 +1,83 @@
+#ifndef LOCAL_FLAG_EVALUATOR_H_
+#define LOCAL_FLAG_EVALUATOR_H_
+
+#include <cstdint>
+#include <memory>
+#include <regex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "posthog_models.h"
+
+// Evaluates feature flags on-device from the definitions served by
+// /api/feature_flag/local_evaluation, using the same rules as PostHog's
+// server-side SDKs: consistent SHA1 rollout hashing, person property filters
+// and multivariate splits. Anything it cannot decide locally (cohorts, group
+// flags, experience continuity, missing properties) is reported as
+// inconclusive so the caller can fall back to the remote /flags/ result.
+class LocalFlagEvaluator {
+ public:
+  LocalFlagEvaluator();
+
+  // Replace the flag definitions. Returns false if the response can't be parsed.
+  bool LoadDefinitions(const std::string& response_json);
+
+  bool HasDefinitions() const;
+
+  // Keys of all loaded flag definitions
+  std::vector<std::string> GetFlagKeys() const;
+
+  // Evaluate flag_key for distinct_id. Returns false if the flag is unknown
+  // or the result is inconclusive; *result is only written on success.
+  bool Evaluate(const std::string& flag_key, const std::string& distinct_id,
+                const json& person_properties, posthog::FeatureFlagValue* result) const;
+
+  // PostHog's consistent hash of "<key>.<distinct_id><salt>" mapped to [0, 1]
+  static double Hash(const std::string& key, const std::string& distinct_id, const std::string& salt = "");
+
+ private:
+  friend class LocalFlagEvaluatorTest;
+
+  struct PropertyFilter {
+    std::string key;
+    std::string op;
+    std::string type;
+    json value;
+    std::shared_ptr<std::regex> regex;  // Compiled once for regex/not_regex
+  };
+
+  struct ConditionGroup {
+    std::vector<PropertyFilter> properties;
+    bool has_rollout = false;
+    double rollout_percentage = 0;
+    std::string variant;
+  };
+
+  struct Variant {
+    std::string key;
+    double rollout_percentage = 0;
+  };
+
+  struct FlagDefinition {
+    std::string key;
+    bool active = false;
+    bool needs_server = false;  // Group flag or experience continuity
+    std::vector<ConditionGroup> groups;  // Variant overrides first
+    std::vector<Variant> variants;
+    std::unordered_map<std::string, std::string> payloads;  // By variant or "true"
+  };
+
+  using Definitions = std::unordered_map<std::string, FlagDefinition>;
+
+  enum class Match { kFalse, kTrue, kInconclusive };
+
+  static Match MatchProperty(const PropertyFilter& filter, const json& properties);
+  Match MatchCondition(const FlagDefinition& flag, const ConditionGroup& group,
+                       const std::string& distinct_id, const json& properties) const;
+  std::string MatchingVariant(const FlagDefinition& flag, const std::string& distinct_id) const;
+
+  // Only accessed through std::atomic_load/std::atomic_store
+  std::shared_ptr<const Definitions> definitions_;
+};
+
+#endif  // LOCAL_FLAG_EVALUATOR_H_
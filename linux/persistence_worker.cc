@@ -0,0 +1,144 @@
+#include "persistence_worker.h"
+#include "storage_manager.h"
+#include "posthog_logger.h"
+#include <vector>
+
+// Upper bound on rows written per SQLite transaction
+static const size_t kMaxBatchRows = 256;
+
+// How long the worker sleeps when idle before re-checking the ring
+static const auto kIdleWait = std::chrono::milliseconds(100);
+
+PersistenceWorker::PersistenceWorker(StorageManager* storage_manager, size_t capacity, OverflowPolicy policy)
+    : storage_manager_(storage_manager),
+      queue_(capacity),
+      overflow_policy_(policy),
+      running_(false),
+      idle_(false),
+      submitted_count_(0),
+      persisted_count_(0),
+      dropped_count_(0) {}
+
+PersistenceWorker::~PersistenceWorker() {
+  Stop();
+}
+
+void PersistenceWorker::Start() {
+  if (running_.exchange(true)) {
+    return;
+  }
+  worker_thread_ = std::thread(&PersistenceWorker::Run, this);
+}
+
+void PersistenceWorker::Stop() {
+  if (running_.exchange(false)) {
+    {
+      std::lock_guard<std::mutex> lock(wake_mutex_);
+    }
+    wake_cv_.notify_all();
+  }
+  if (worker_thread_.joinable()) {
+    worker_thread_.join();
+  }
+
+  // Persist whatever producers managed to enqueue before shutdown
+  while (DrainAndPersist() > 0) {
+  }
+}
+
+bool PersistenceWorker::Submit(std::string event_json) {
+  if (queue_.TryPush(event_json)) {
+    submitted_count_.fetch_add(1, std::memory_order_release);
+    if (idle_.load(std::memory_order_acquire)) {
+      wake_cv_.notify_one();
+    }
+    return true;
+  }
+
+  // Ring is full: apply the overflow policy
+  if (overflow_policy_ == OverflowPolicy::WRITE_THROUGH && storage_manager_) {
+    return storage_manager_->EnqueueEvent(event_json);
+  }
+
+  uint64_t dropped = dropped_count_.fetch_add(1, std::memory_order_relaxed) + 1;
+  if (dropped == 1 || dropped % 100 == 0) {
+    PostHogLogger::Error("Ingestion queue full, dropped " + std::to_string(dropped) + " events so far");
+  }
+  return false;
+}
+
+bool PersistenceWorker::WaitForDrain(std::chrono::milliseconds timeout) {
+  uint64_t target = submitted_count_.load(std::memory_order_acquire);
+  if (persisted_count_.load(std::memory_order_acquire) >= target) {
+    return true;
+  }
+
+  wake_cv_.notify_one();
+  std::unique_lock<std::mutex> lock(wake_mutex_);
+  return drained_cv_.wait_for(lock, timeout, [this, target] {
+    return persisted_count_.load(std::memory_order_acquire) >= target;
+  });
+}
+
+size_t PersistenceWorker::DrainAndPersist() {
+  std::vector<std::string> batch;
+  std::string event_json;
+  while (batch.size() < kMaxBatchRows && queue_.TryPop(event_json)) {
+    batch.push_back(std::move(event_json));
+  }
+  if (batch.empty()) {
+    return 0;
+  }
+
+  if (!storage_manager_) {
+    PostHogLogger::Error("Failed to persist " + std::to_string(batch.size()) + " events");
+  } else if (!storage_manager_->EnqueueEvents(batch)) {
+    // Nothing from the batch was written. Retry row by row, so a transient
+    // failure or a single bad row costs at most the rows that still fail.
+    size_t lost = 0;
+    for (const std::string& event : batch) {
+      if (!storage_manager_->EnqueueEvent(event)) {
+        lost++;
+      }
+    }
+    if (lost > 0) {
+      dropped_count_.fetch_add(lost, std::memory_order_relaxed);
+      PostHogLogger::Error("Failed to persist " + std::to_string(lost) + " of " + std::to_string(batch.size())
+                           + " events");
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    persisted_count_.fetch_add(batch.size(), std::memory_order_release);
+  }
+  drained_cv_.notify_all();
+  return batch.size();
+}
+
+void PersistenceWorker::Run() {
+  while (running_.load(std::memory_order_acquire)) {
+    size_t written = 0;
+    try {
+      written = DrainAndPersist();
+      if (written > 0 && persisted_callback_) {
+        persisted_callback_();
+      }
+    } catch (const std::exception& e) {
+      PostHogLogger::Error("Error in persistence worker: " + std::string(e.what()));
+    }
+
+    if (written > 0) {
+      continue;
+    }
+
+    // Nothing to do: sleep until a producer wakes us or the idle timeout expires.
+    // Producers notify without taking the lock, so the timeout bounds a missed wakeup.
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    idle_.store(true, std::memory_order_release);
+    wake_cv_.wait_for(lock, kIdleWait, [this] {
+      return !running_.load(std::memory_order_acquire) || queue_.SizeApprox() > 0;
+    });
+    idle_.store(false, std::memory_order_release);
+  }
+}
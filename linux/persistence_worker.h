@@ -0,0 +1,72 @@
+#ifndef PERSISTENCE_WORKER_H_
+#define PERSISTENCE_WORKER_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "ingestion_queue.h"
+
+class StorageManager;
+
+// What Submit() does when the ingestion ring is full
+enum class OverflowPolicy {
+  DROP_NEWEST = 0,    // Reject the new event and count it as dropped
+  // Write the event to SQLite on the calling thread. It lands ahead of the
+  // older events still waiting in the ring, so a burst that overflows is
+  // stored (and sent) slightly out of order. The ring has a single consumer,
+  // so the producer can't drain it first.
+  WRITE_THROUGH = 1
+};
+
+// Owns all SQLite event writes. Handlers serialize an event and Submit() it;
+// the worker thread drains the ring and persists each drained batch in a
+// single transaction.
+class PersistenceWorker {
+ public:
+  PersistenceWorker(StorageManager* storage_manager, size_t capacity, OverflowPolicy policy);
+  ~PersistenceWorker();
+
+  void Start();
+
+  // Stops the worker thread and persists anything still in the ring
+  void Stop();
+
+  // Enqueue a serialized event. Safe to call from any thread.
+  bool Submit(std::string event_json);
+
+  // Block until everything submitted before this call has been persisted
+  bool WaitForDrain(std::chrono::milliseconds timeout);
+
+  // Invoked on the worker thread after each batch is written
+  void SetPersistedCallback(std::function<void()> callback) { persisted_callback_ = std::move(callback); }
+
+  // Events lost to DROP_NEWEST overflow or to writes that failed even row by row
+  uint64_t GetDroppedCount() const { return dropped_count_.load(std::memory_order_relaxed); }
+
+ private:
+  void Run();
+  size_t DrainAndPersist();
+
+  StorageManager* storage_manager_;
+  IngestionQueue queue_;
+  OverflowPolicy overflow_policy_;
+  std::function<void()> persisted_callback_;
+
+  std::thread worker_thread_;
+  std::atomic<bool> running_;
+  std::atomic<bool> idle_;
+  std::mutex wake_mutex_;
+  std::condition_variable wake_cv_;
+  std::condition_variable drained_cv_;
+
+  std::atomic<uint64_t> submitted_count_;
+  std::atomic<uint64_t> persisted_count_;
+  std::atomic<uint64_t> dropped_count_;
+};
+
+#endif  // PERSISTENCE_WORKER_H_
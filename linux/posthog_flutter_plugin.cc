@@ -5,6 +5,12 @@
 #include "session_replay_manager.h"
 #include "posthog_models.h"
 #include "posthog_logger.h"
+#include "persistence_worker.h"
+#include "flush_coordinator.h"
+#include "flag_exposure_tracker.h"
+#include "uuid_generator.h"
+#include "task_executor.h"
+#include "posthog_metrics.h"
 
 #include <flutter_linux/flutter_linux.h>
 #include <gtk/gtk.h>
@@ -17,9 +23,14 @@
 #include <chrono>
 #include <sstream>
 #include <iomanip>
-#include <random>
 #include <ctime>
 #include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <unordered_map>
+#include <vector>
 
 using json = nlohmann::json;
 
@@ -27,6 +38,29 @@ using json = nlohmann::json;
   (G_TYPE_CHECK_INSTANCE_CAST((obj), posthog_flutter_plugin_get_type(), \
                               PosthogFlutterPlugin))
 
+// Bounds on the in-memory ingestion ring, sized from maxQueueSize
+static const int kMinIngestionRingSize = 2;
+static const int kMaxIngestionRingSize = 1 << 16;
+
+// Number of threads used to run blocking method calls off the main loop
+static const size_t kExecutorThreads = 2;
+
+// Method calls that block the main loop longer than this are logged (~one 60Hz frame)
+static const int64_t kMainLoopStallWarningUs = 16000;
+
+// $feature_flag_called dedupe cache size, and how exposures are batched into the queue
+static const size_t kFlagExposureCacheSize = 50000;
+static const size_t kFlagExposureBatchSize = 50;
+static const guint kFlagExposureFlushDelayMs = 1000;
+
+// Background flag refresh: failures double the interval up to this cap, and every
+// delay is spread by +/- this fraction so devices started together don't stay in step
+static const double kFlagRefreshMaxBackoffSeconds = 3600;
+static const double kFlagRefreshJitter = 0.1;
+
+// Feature flags secure API keys, the only keys accepted for local evaluation
+static const char kFlagsSecureApiKeyPrefix[] = "phs_";
+
 // Helper function to get current timestamp in milliseconds since epoch
 static int64_t get_current_timestamp_ms() {
   return std::chrono::duration_cast<std::chrono::milliseconds>(
@@ -63,16 +97,64 @@ static json fl_value_to_json_obj(FlValue* value) {
       return arr;
     }
     case FL_VALUE_TYPE_MAP: {
-      // Flutter Linux FlValue API doesn't provide a way to enumerate map keys.
-      // Properties are handled manually in handle_capture() by checking for known keys.
-      // This is a limitation of the Flutter Linux platform channel API.
-      return json::object();
+      json obj = json::object();
+      size_t length = fl_value_get_length(value);
+      for (size_t i = 0; i < length; i++) {
+        FlValue* key = fl_value_get_map_key(value, i);
+        if (fl_value_get_type(key) == FL_VALUE_TYPE_STRING) {
+          obj[fl_value_get_string(key)] = fl_value_to_json_obj(fl_value_get_map_value(value, i));
+        }
+      }
+      return obj;
     }
     default:
       return json("<unknown>");
   }
 }
 
+// Helper function to convert nlohmann::json to a new FlValue
+static FlValue* json_to_fl_value(const json& value) {
+  switch (value.type()) {
+    case json::value_t::boolean:
+      return fl_value_new_bool(value.get<bool>());
+    case json::value_t::number_integer:
+    case json::value_t::number_unsigned:
+      return fl_value_new_int(value.get<int64_t>());
+    case json::value_t::number_float:
+      return fl_value_new_float(value.get<double>());
+    case json::value_t::string:
+      return fl_value_new_string(value.get_ref<const std::string&>().c_str());
+    case json::value_t::array: {
+      FlValue* list = fl_value_new_list();
+      for (const auto& item : value) {
+        fl_value_append_take(list, json_to_fl_value(item));
+      }
+      return list;
+    }
+    case json::value_t::object: {
+      FlValue* map = fl_value_new_map();
+      for (const auto& item : value.items()) {
+        fl_value_set_string_take(map, item.key().c_str(), json_to_fl_value(item.value()));
+      }
+      return map;
+    }
+    default:
+      return fl_value_new_null();
+  }
+}
+
+
+// A flag payload decoded on first request, reused while the raw payload is unchanged
+struct DecodedPayload {
+  std::string payload_json;
+  FlValue* value;
+};
+
+// A method call that arrived before setup finished, with the time it was received
+struct PendingMethodCall {
+  FlMethodCall* method_call;
+  int64_t timestamp_ms;
+};
 
 // Complete struct definition (matches header forward declaration)
 struct _PosthogFlutterPlugin {
@@ -83,8 +165,12 @@ struct _PosthogFlutterPlugin {
   HttpClient* http_client;
   FeatureFlagsManager* feature_flags_manager;
   SessionReplayManager* session_replay_manager;
+  PersistenceWorker* persistence_worker;
+  FlushCoordinator* flush_coordinator;
+  TaskExecutor* executor;
   
   std::string api_key;
+  std::string secure_api_key;  // Feature flags secure API key; enables local evaluation
   std::string host;
   int flush_at;
   int max_queue_size;
@@ -93,11 +179,34 @@ struct _PosthogFlutterPlugin {
   bool debug;
   bool opt_out;
   bool initialized;
+  bool initializing;
   bool session_replay_enabled;
   
   std::thread flush_thread;
   bool should_flush;
   std::mutex config_mutex;
+  
+  // Wakes flush_events_thread early (e.g. when the queue reaches flush_at)
+  std::mutex flush_mutex;
+  std::condition_variable flush_cv;
+  bool flush_requested;
+  
+  // Method calls received while setup is still initializing, replayed in order afterwards
+  std::vector<PendingMethodCall>* pending_calls;
+
+  // Decoded flag payloads by flag key (main thread only)
+  std::unordered_map<std::string, DecodedPayload>* payload_cache;
+
+  // $feature_flag_called reporting (main thread only)
+  bool send_feature_flag_events;
+  bool notify_flag_changes;  // Dart registered onFeatureFlags
+  FlagExposureTracker* exposure_tracker;
+  guint exposure_flush_source;
+
+  // Background flag refresh (main thread only); disabled when the interval is 0
+  int flag_refresh_interval_seconds;
+  int flag_refresh_failures;
+  guint flag_refresh_source;
 };
 
 // Class struct definition (must be before G_DEFINE_TYPE)
@@ -110,12 +219,16 @@ G_DEFINE_TYPE(PosthogFlutterPlugin, posthog_flutter_plugin, g_object_get_type())
 // Forward declarations
 static void handle_method_call(FlMethodChannel* channel, FlMethodCall* method_call,
                                gpointer user_data);
+static void dispatch_method_call(FlMethodChannel* channel, FlMethodCall* method_call,
+                                 gpointer user_data, int64_t timestamp_ms);
 static void posthog_flutter_plugin_dispose(GObject* object);
 static std::string get_app_data_dir();
-static std::string generate_uuid();
 static std::string get_or_create_distinct_id(StorageManager* storage);
 static std::string get_or_create_session_id(StorageManager* storage);
 static void flush_events_thread(PosthogFlutterPlugin* plugin);
+static void enqueue_event(PosthogFlutterPlugin* plugin, posthog::PostHogEvent& event);
+static void request_flush(PosthogFlutterPlugin* plugin);
+static void flush_flag_exposures(PosthogFlutterPlugin* plugin);
 
 // Helper function to get app data directory
 static std::string get_app_data_dir() {
@@ -135,34 +248,10 @@ static std::string get_app_data_dir() {
   return dir;
 }
 
-// Generate UUID v4
-static std::string generate_uuid() {
-  std::random_device rd;
-  std::mt19937 gen(rd());
-  std::uniform_int_distribution<> dis(0, 15);
-  std::uniform_int_distribution<> dis2(8, 11);
-
-  std::ostringstream oss;
-  oss << std::hex;
-  for (int i = 0; i < 32; i++) {
-    if (i == 8 || i == 12 || i == 16 || i == 20) {
-      oss << "-";
-    }
-    if (i == 12) {
-      oss << "4";
-    } else if (i == 16) {
-      oss << dis2(gen);
-    } else {
-      oss << dis(gen);
-    }
-  }
-  return oss.str();
-}
-
 static std::string get_or_create_distinct_id(StorageManager* storage) {
   std::string distinct_id = storage->GetDistinctId();
   if (distinct_id.empty()) {
-    distinct_id = generate_uuid();
+    distinct_id = posthog::GenerateUuid();
     storage->SetDistinctId(distinct_id);
   }
   return distinct_id;
@@ -171,60 +260,71 @@ static std::string get_or_create_distinct_id(StorageManager* storage) {
 static std::string get_or_create_session_id(StorageManager* storage) {
   std::string session_id = storage->GetSessionId();
   if (session_id.empty()) {
-    session_id = generate_uuid();
+    session_id = posthog::GenerateUuid();
     storage->SetSessionId(session_id);
   }
   return session_id;
 }
 
+// Serialize an event and hand it to the persistence worker.
+// This is the only work a capture does on the platform thread. If the ring is
+// full the event is written through straight away, ahead of older events still
+// in the ring (see OverflowPolicy::WRITE_THROUGH).
+static void enqueue_event(PosthogFlutterPlugin* plugin, posthog::PostHogEvent& event) {
+  if (event.uuid.empty()) {
+    event.uuid = posthog::GenerateUuid();
+  }
+  std::string event_json = event.to_json().dump();
+  if (plugin->persistence_worker) {
+    plugin->persistence_worker->Submit(std::move(event_json));
+  } else if (plugin->storage_manager) {
+    plugin->storage_manager->EnqueueEvent(event_json);
+  }
+}
+
+// Wake the flush thread without waiting for the flush interval
+static void request_flush(PosthogFlutterPlugin* plugin) {
+  {
+    std::lock_guard<std::mutex> lock(plugin->flush_mutex);
+    plugin->flush_requested = true;
+  }
+  plugin->flush_cv.notify_one();
+}
+
 // Flush events in background thread
 static void flush_events_thread(PosthogFlutterPlugin* plugin) {
   while (plugin->should_flush) {
-    std::this_thread::sleep_for(std::chrono::seconds(plugin->flush_interval_seconds));
-    
-    if (!plugin->should_flush) break;
-    
-    std::lock_guard<std::mutex> lock(plugin->config_mutex);
-    
-    // CRITICAL: Check pointers before use to prevent segfaults
-    // These can become null if plugin is being disposed
-    if (!plugin->storage_manager || !plugin->http_client) {
-      // Pointers are null (plugin being disposed), exit thread
-      break;
+    {
+      // Sleep for the flush interval, or until a flush is requested
+      std::unique_lock<std::mutex> flush_lock(plugin->flush_mutex);
+      plugin->flush_cv.wait_for(flush_lock, std::chrono::seconds(plugin->flush_interval_seconds), [plugin] {
+        return !plugin->should_flush || plugin->flush_requested;
+      });
+      plugin->flush_requested = false;
     }
     
-    if (plugin->opt_out || !plugin->initialized) {
-      continue;
-    }
+    if (!plugin->should_flush) break;
     
-    try {
-      std::vector<std::string> events = plugin->storage_manager->GetQueuedEvents(plugin->max_batch_size);
-      if (events.empty()) {
-        continue;
-      }
-      
-      std::vector<std::string> event_jsons;
-      std::vector<std::string> event_ids;
+    FlushCoordinator* flush_coordinator;
+    {
+      // Only hold the config lock while reading state, not during the upload
+      std::lock_guard<std::mutex> lock(plugin->config_mutex);
       
-      for (const auto& event_with_id : events) {
-        size_t pos = event_with_id.find('|');
-        if (pos != std::string::npos) {
-          event_ids.push_back(event_with_id.substr(0, pos));
-          event_jsons.push_back(event_with_id.substr(pos + 1));
-        }
+      // CRITICAL: Check pointers before use to prevent segfaults
+      // These can become null if plugin is being disposed
+      if (!plugin->flush_coordinator) {
+        // Pointers are null (plugin being disposed), exit thread
+        break;
       }
       
-      if (!event_jsons.empty()) {
-        // Double-check pointers are still valid after processing
-        if (!plugin->http_client || !plugin->storage_manager) {
-          break;
-        }
-        
-        HttpResponse response = plugin->http_client->PostCapture(event_jsons);
-        if (response.success && plugin->storage_manager) {
-          plugin->storage_manager->RemoveEvents(event_ids);
-        }
+      if (plugin->opt_out || !plugin->initialized) {
+        continue;
       }
+      flush_coordinator = plugin->flush_coordinator;
+    }
+    
+    try {
+      flush_coordinator->Flush();
     } catch (const std::exception& e) {
       PostHogLogger::Error("Error in flush thread: " + std::string(e.what()));
       // Continue loop - don't crash the thread
@@ -237,11 +337,48 @@ static void flush_events_thread(PosthogFlutterPlugin* plugin) {
 
 static void posthog_flutter_plugin_dispose(GObject* object) {
   PosthogFlutterPlugin* plugin = POSTHOG_FLUTTER_PLUGIN(object);
+
+  if (plugin->flag_refresh_source) {
+    g_source_remove(plugin->flag_refresh_source);
+    plugin->flag_refresh_source = 0;
+  }
+
+  // Reloads drained below must not queue notifications for a plugin being torn down
+  if (plugin->feature_flags_manager) {
+    plugin->feature_flags_manager->SetFlagsChangedCallback(nullptr);
+  }
+
+  // Queue any exposures still waiting for their batch while storage is open
+  if (plugin->exposure_flush_source) {
+    g_source_remove(plugin->exposure_flush_source);
+    plugin->exposure_flush_source = 0;
+  }
+  if (plugin->exposure_tracker) {
+    flush_flag_exposures(plugin);
+    delete plugin->exposure_tracker;
+    plugin->exposure_tracker = nullptr;
+  }
+
+  // Method-call tasks hold a plugin reference, so only flag network work (preload,
+  // background refreshes, definition downloads) can still be queued or running.
+  // Cancel it so Shutdown doesn't wait out request timeouts on the main thread.
+  if (plugin->feature_flags_manager) {
+    plugin->feature_flags_manager->Cancel();
+  }
+  if (plugin->executor) {
+    plugin->executor->Shutdown();
+    delete plugin->executor;
+    plugin->executor = nullptr;
+  }
   
   {
     std::lock_guard<std::mutex> lock(plugin->config_mutex);
     plugin->should_flush = false;
   }
+  plugin->flush_cv.notify_all();
+  if (plugin->flush_coordinator) {
+    plugin->flush_coordinator->Cancel();
+  }
   
   // CRITICAL: Stop session replay manager FIRST, before stopping main flush thread
   // This ensures its background thread stops before we delete http_client/storage_manager
@@ -257,6 +394,20 @@ static void posthog_flutter_plugin_dispose(GObject* object) {
     plugin->flush_thread.join();
   }
   
+  if (plugin->flush_coordinator) {
+    PostHogLogger::Debug("Flush: " + std::to_string(plugin->flush_coordinator->GetSentCount()) + " events sent, "
+                         + std::to_string(plugin->flush_coordinator->GetDuplicateSendCount()) + " duplicate sends");
+    delete plugin->flush_coordinator;
+    plugin->flush_coordinator = nullptr;
+  }
+  
+  // Persist any events still sitting in the ingestion queue before closing storage
+  if (plugin->persistence_worker) {
+    plugin->persistence_worker->Stop();
+    delete plugin->persistence_worker;
+    plugin->persistence_worker = nullptr;
+  }
+  
   // Now safe to delete storage_manager and http_client
   // (session_replay_manager background thread is stopped)
   if (plugin->storage_manager) {
@@ -275,6 +426,25 @@ static void posthog_flutter_plugin_dispose(GObject* object) {
     plugin->feature_flags_manager = nullptr;
   }
   
+  if (plugin->pending_calls) {
+    for (const PendingMethodCall& call : *plugin->pending_calls) {
+      fl_method_call_respond_success(call.method_call, nullptr, nullptr);
+      g_object_unref(call.method_call);
+    }
+    delete plugin->pending_calls;
+    plugin->pending_calls = nullptr;
+  }
+  
+  if (plugin->payload_cache) {
+    for (auto& entry : *plugin->payload_cache) {
+      fl_value_unref(entry.second.value);
+    }
+    delete plugin->payload_cache;
+    plugin->payload_cache = nullptr;
+  }
+  
+  PostHogMetrics::LogSummary();
+  
   g_clear_object(&plugin->channel);
   
   G_OBJECT_CLASS(posthog_flutter_plugin_parent_class)->dispose(object);
@@ -290,8 +460,22 @@ static void posthog_flutter_plugin_init(PosthogFlutterPlugin* self) {
   self->http_client = nullptr;
   self->feature_flags_manager = nullptr;
   self->session_replay_manager = nullptr;
+  self->persistence_worker = nullptr;
+  self->flush_coordinator = nullptr;
+  self->executor = new TaskExecutor(kExecutorThreads);
+  self->pending_calls = new std::vector<PendingMethodCall>();
+  self->payload_cache = new std::unordered_map<std::string, DecodedPayload>();
+  self->exposure_tracker = new FlagExposureTracker(kFlagExposureCacheSize);
+  self->exposure_flush_source = 0;
+  self->send_feature_flag_events = true;
+  self->notify_flag_changes = false;
+  self->flag_refresh_interval_seconds = 0;
+  self->flag_refresh_failures = 0;
+  self->flag_refresh_source = 0;
   self->initialized = false;
+  self->initializing = false;
   self->should_flush = false;
+  self->flush_requested = false;
   self->session_replay_enabled = false;
   self->flush_at = 20;
   self->max_queue_size = 1000;
@@ -301,26 +485,185 @@ static void posthog_flutter_plugin_init(PosthogFlutterPlugin* self) {
   self->opt_out = false;
 }
 
-// Handle setup method
-static void handle_setup(PosthogFlutterPlugin* plugin, FlValue* args) {
-  if (plugin->initialized) {
-    return;
+// Work run on the executor; returns the method call's result (may be nullptr)
+using AsyncHandler = std::function<FlValue*(PosthogFlutterPlugin*)>;
+
+// Result of an offloaded method call waiting to be delivered on the main context
+struct AsyncResponse {
+  PosthogFlutterPlugin* plugin;
+  FlMethodCall* method_call;
+  FlValue* result;
+};
+
+static gboolean respond_on_main_context(gpointer user_data) {
+  AsyncResponse* response = static_cast<AsyncResponse*>(user_data);
+  fl_method_call_respond_success(response->method_call, response->result, nullptr);
+  return G_SOURCE_REMOVE;
+}
+
+static void free_async_response(gpointer user_data) {
+  AsyncResponse* response = static_cast<AsyncResponse*>(user_data);
+  if (response->result) {
+    fl_value_unref(response->result);
   }
+  g_object_unref(response->method_call);
+  // May drop the last plugin reference; safe because this runs on the main context
+  g_object_unref(response->plugin);
+  delete response;
+}
+
+// Respond to method_call from the main context. Takes over one reference each
+// to plugin and method_call, and ownership of result; callable from any thread.
+static void respond_from_main_context(PosthogFlutterPlugin* plugin, FlMethodCall* method_call, FlValue* result) {
+  AsyncResponse* response = new AsyncResponse{plugin, method_call, result};
+  g_main_context_invoke_full(nullptr, G_PRIORITY_DEFAULT, respond_on_main_context,
+                             response, free_async_response);
+}
+
+// Run handler on the executor and respond to method_call from the main context
+// once it finishes. Falls back to running inline if the executor is gone.
+static void run_async(PosthogFlutterPlugin* plugin, FlMethodCall* method_call, AsyncHandler handler) {
+  g_object_ref(plugin);
+  g_object_ref(method_call);
+  
+  auto task = [plugin, method_call, handler]() {
+    FlValue* result = nullptr;
+    try {
+      result = handler(plugin);
+    } catch (const std::exception& e) {
+      PostHogLogger::Error("Error in async method call: " + std::string(e.what()));
+    }
+    respond_from_main_context(plugin, method_call, result);
+  };
   
-  if (fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
-    return;
+  if (!plugin->executor || !plugin->executor->Post(task)) {
+    FlValue* result = handler(plugin);
+    fl_method_call_respond_success(method_call, result, nullptr);
+    if (result) {
+      fl_value_unref(result);
+    }
+    g_object_unref(method_call);
+    g_object_unref(plugin);
+  }
+}
+
+// Keys that changed in a flag reload, on their way to the main context
+struct FlagChangeNotification {
+  PosthogFlutterPlugin* plugin;
+  std::vector<std::string> changed_keys;
+};
+
+// Push the new values of changed flags to Dart's onFeatureFlags callback
+// (null for removed flags), so Dart never has to poll for changes.
+static gboolean notify_flag_changes_on_main_context(gpointer user_data) {
+  FlagChangeNotification* notification = static_cast<FlagChangeNotification*>(user_data);
+  PosthogFlutterPlugin* plugin = notification->plugin;
+  // Published by setup on a worker thread; dispose clears it on this one
+  FeatureFlagsManager* feature_flags_manager = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(plugin->config_mutex);
+    feature_flags_manager = plugin->feature_flags_manager;
+  }
+  // Queued just before dispose: there is nobody left to tell
+  if (!plugin->channel || !feature_flags_manager) {
+    return G_SOURCE_REMOVE;
+  }
+  
+  g_autoptr(FlValue) changed_flags = fl_value_new_map();
+  for (const std::string& flag_key : notification->changed_keys) {
+    std::string value = feature_flags_manager->GetFeatureFlag(flag_key);
+    FlValue* flag_value = value.empty() ? fl_value_new_null()
+                          : value == "true" ? fl_value_new_bool(true)
+                          : value == "false" ? fl_value_new_bool(false)
+                          : fl_value_new_string(value.c_str());
+    fl_value_set_string_take(changed_flags, flag_key.c_str(), flag_value);
+  }
+  
+  g_autoptr(FlValue) args = fl_value_new_map();
+  fl_value_set_string(args, "changedFlags", changed_flags);
+  fl_method_channel_invoke_method(plugin->channel, "onFeatureFlags", args, nullptr, nullptr, nullptr);
+  return G_SOURCE_REMOVE;
+}
+
+static void free_flag_change_notification(gpointer user_data) {
+  FlagChangeNotification* notification = static_cast<FlagChangeNotification*>(user_data);
+  g_object_unref(notification->plugin);
+  delete notification;
+}
+
+// FeatureFlagsManager's change callback; runs on the reloading thread
+static void post_flag_changes(PosthogFlutterPlugin* plugin, const std::vector<std::string>& changed_keys) {
+  g_object_ref(plugin);
+  g_main_context_invoke_full(nullptr, G_PRIORITY_DEFAULT, notify_flag_changes_on_main_context,
+                             new FlagChangeNotification{plugin, changed_keys}, free_flag_change_notification);
+}
+
+// Setup options only needed while initializing (everything else lives on the plugin)
+struct SetupOptions {
+  bool session_replay = false;
+  int replay_compression_quality = -1;
+  int replay_batch_size = -1;
+  int replay_batch_interval_ms = -1;
+  int replay_max_image_dimension = -1;
+  int replay_keyframe_interval_ms = -1;
+  bool preload_flags = true;
+  std::string bootstrap_flags_json;  // Inline bootstrap values, serialized
+  std::string bootstrap_flags_path;  // JSON file bundled with the app
+};
+
+// Seed flags from the app's bootstrap file and/or inline values so the first
+// reads are right on a cold start without waiting for the network
+static void bootstrap_feature_flags(FeatureFlagsManager* feature_flags_manager, const SetupOptions& options) {
+  if (!options.bootstrap_flags_path.empty()) {
+    gchar* contents = nullptr;
+    gsize length = 0;
+    GError* error = nullptr;
+    if (g_file_get_contents(options.bootstrap_flags_path.c_str(), &contents, &length, &error)) {
+      feature_flags_manager->Bootstrap(std::string(contents, length));
+      g_free(contents);
+    } else {
+      PostHogLogger::Error("Failed to read bootstrap flags from " + options.bootstrap_flags_path + ": "
+                           + (error ? error->message : "unknown error"));
+      g_clear_error(&error);
+    }
+  }
+  
+  if (!options.bootstrap_flags_json.empty()) {
+    feature_flags_manager->Bootstrap(options.bootstrap_flags_json);
+  }
+}
+
+// Parse setup arguments into the plugin config. Cheap; runs on the main thread.
+static bool parse_setup_args(PosthogFlutterPlugin* plugin, FlValue* args, SetupOptions& options) {
+  if (!args || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
+    return false;
   }
   
   FlValue* api_key_value = fl_value_lookup_string(args, "apiKey");
   if (!api_key_value || fl_value_get_type(api_key_value) != FL_VALUE_TYPE_STRING) {
-    return;
+    return false;
   }
   
   plugin->api_key = fl_value_get_string(api_key_value);
   // Guard against empty API key to prevent crashes in downstream components.
   if (plugin->api_key.empty()) {
     PostHogLogger::Error("PostHog setup called with empty API key. Skipping initialization.");
-    return;
+    return false;
+  }
+  
+  // Anything in the app binary can be extracted, so only a feature flags secure
+  // API key (read-only access to flag definitions) is accepted. A personal API
+  // key would hand out access to the whole PostHog account.
+  FlValue* secure_api_key_value = fl_value_lookup_string(args, "featureFlagsSecureApiKey");
+  if (secure_api_key_value && fl_value_get_type(secure_api_key_value) == FL_VALUE_TYPE_STRING) {
+    std::string secure_api_key = fl_value_get_string(secure_api_key_value);
+    if (secure_api_key.rfind(kFlagsSecureApiKeyPrefix, 0) == 0) {
+      plugin->secure_api_key = secure_api_key;
+    } else {
+      PostHogLogger::Error("featureFlagsSecureApiKey is not a feature flags secure API key (" +
+                           std::string(kFlagsSecureApiKeyPrefix) +
+                           "...); never ship a personal API key in an app. Local flag evaluation is disabled.");
+    }
   }
   
   FlValue* host_value = fl_value_lookup_string(args, "host");
@@ -365,97 +708,197 @@ static void handle_setup(PosthogFlutterPlugin* plugin, FlValue* args) {
     plugin->opt_out = fl_value_get_bool(opt_out_value);
   }
   
+  FlValue* flag_refresh_value = fl_value_lookup_string(args, "featureFlagRefreshInterval");
+  if (flag_refresh_value && fl_value_get_type(flag_refresh_value) == FL_VALUE_TYPE_INT) {
+    plugin->flag_refresh_interval_seconds = std::max<int64_t>(0, fl_value_get_int(flag_refresh_value));
+  }
+  
+  FlValue* notify_flag_changes_value = fl_value_lookup_string(args, "notifyFeatureFlagChanges");
+  if (notify_flag_changes_value && fl_value_get_type(notify_flag_changes_value) == FL_VALUE_TYPE_BOOL) {
+    plugin->notify_flag_changes = fl_value_get_bool(notify_flag_changes_value);
+  }
+  
+  FlValue* send_flag_events_value = fl_value_lookup_string(args, "sendFeatureFlagEvents");
+  if (send_flag_events_value && fl_value_get_type(send_flag_events_value) == FL_VALUE_TYPE_BOOL) {
+    plugin->send_feature_flag_events = fl_value_get_bool(send_flag_events_value);
+  }
+  
+  FlValue* session_replay_value = fl_value_lookup_string(args, "sessionReplay");
+  if (session_replay_value && fl_value_get_type(session_replay_value) == FL_VALUE_TYPE_BOOL) {
+    options.session_replay = fl_value_get_bool(session_replay_value);
+  }
+  
+  // Session replay settings
+  FlValue* replay_config_value = fl_value_lookup_string(args, "sessionReplayConfig");
+  if (replay_config_value && fl_value_get_type(replay_config_value) == FL_VALUE_TYPE_MAP) {
+    FlValue* quality_value = fl_value_lookup_string(replay_config_value, "compressionQuality");
+    if (quality_value && fl_value_get_type(quality_value) == FL_VALUE_TYPE_INT) {
+      options.replay_compression_quality = fl_value_get_int(quality_value);
+    }
+    
+    FlValue* batch_size_value = fl_value_lookup_string(replay_config_value, "batchSize");
+    if (batch_size_value && fl_value_get_type(batch_size_value) == FL_VALUE_TYPE_INT) {
+      options.replay_batch_size = fl_value_get_int(batch_size_value);
+    }
+    
+    FlValue* batch_interval_value = fl_value_lookup_string(replay_config_value, "batchIntervalMs");
+    if (batch_interval_value && fl_value_get_type(batch_interval_value) == FL_VALUE_TYPE_INT) {
+      options.replay_batch_interval_ms = fl_value_get_int(batch_interval_value);
+    }
+    
+    FlValue* max_dim_value = fl_value_lookup_string(replay_config_value, "maxImageDimension");
+    if (max_dim_value && fl_value_get_type(max_dim_value) == FL_VALUE_TYPE_INT) {
+      options.replay_max_image_dimension = fl_value_get_int(max_dim_value);
+    }
+    
+    FlValue* keyframe_interval_value = fl_value_lookup_string(replay_config_value, "keyframeIntervalMs");
+    if (keyframe_interval_value && fl_value_get_type(keyframe_interval_value) == FL_VALUE_TYPE_INT) {
+      options.replay_keyframe_interval_ms = fl_value_get_int(keyframe_interval_value);
+    }
+  }
+  
+  // Bootstrap flags, inline or from a JSON file; served until the first /flags/ response
+  FlValue* bootstrap_value = fl_value_lookup_string(args, "bootstrap");
+  if (bootstrap_value && fl_value_get_type(bootstrap_value) == FL_VALUE_TYPE_MAP) {
+    options.bootstrap_flags_json = fl_value_to_json_obj(bootstrap_value).dump();
+  }
+  
+  FlValue* bootstrap_path_value = fl_value_lookup_string(args, "bootstrapPath");
+  if (bootstrap_path_value && fl_value_get_type(bootstrap_path_value) == FL_VALUE_TYPE_STRING) {
+    options.bootstrap_flags_path = fl_value_get_string(bootstrap_path_value);
+  }
+  
+  // Preload feature flags if enabled
+  FlValue* preload_flags_value = fl_value_lookup_string(args, "preloadFeatureFlags");
+  if (preload_flags_value && fl_value_get_type(preload_flags_value) == FL_VALUE_TYPE_BOOL) {
+    options.preload_flags = fl_value_get_bool(preload_flags_value);
+  }
+  
+  return true;
+}
+
+// Create storage, HTTP client and managers, then publish them to the plugin.
+// Runs on the executor so SQLite and curl setup never block the main loop.
+// Returns the distinct ID on success, or an empty string on failure.
+static std::string initialize_plugin(PosthogFlutterPlugin* plugin, const SetupOptions& options) {
   // Initialize storage
-  std::string app_data_dir = get_app_data_dir();
-  plugin->storage_manager = new StorageManager();
-  if (!plugin->storage_manager->Initialize(app_data_dir)) {
-    PostHogLogger::Error("Failed to initialize storage");
-    delete plugin->storage_manager;
-    plugin->storage_manager = nullptr;
-    return;
+  StorageManager* storage_manager = new StorageManager();
+  {
+    ScopedTimer timer("setup.storage_open");
+    std::string app_data_dir = get_app_data_dir();
+    if (!storage_manager->Initialize(app_data_dir)) {
+      PostHogLogger::Error("Failed to initialize storage");
+      delete storage_manager;
+      return "";
+    }
   }
   
   // Initialize HTTP client
-  plugin->http_client = new HttpClient();
-  if (!plugin->http_client->Initialize()) {
-    PostHogLogger::Error("Failed to initialize HTTP client");
-    delete plugin->http_client;
-    plugin->http_client = nullptr;
-    return;
+  HttpClient* http_client = new HttpClient();
+  {
+    ScopedTimer timer("setup.http_init");
+    if (!http_client->Initialize()) {
+      PostHogLogger::Error("Failed to initialize HTTP client");
+      delete http_client;
+      storage_manager->Close();
+      delete storage_manager;
+      return "";
+    }
   }
   
-  plugin->http_client->SetBaseUrl(plugin->host);
-  plugin->http_client->SetApiKey(plugin->api_key);
-  plugin->http_client->SetDebug(plugin->debug);
+  http_client->SetBaseUrl(plugin->host);
+  http_client->SetApiKey(plugin->api_key);
+  http_client->SetDebug(plugin->debug);
+  
+  // Start the persistence worker that owns all event writes to SQLite.
+  // Once the stored queue reaches flush_at it wakes the flush thread.
+  // maxQueueSize is the app's bound on unsent events, so the ring (events not
+  // yet on disk) uses it too; clamped since it comes straight from Dart and a
+  // bad value must not hang or exhaust memory when the ring is allocated.
+  size_t ring_size = static_cast<size_t>(
+      std::clamp(plugin->max_queue_size, kMinIngestionRingSize, kMaxIngestionRingSize));
+  PersistenceWorker* persistence_worker = new PersistenceWorker(
+      storage_manager, ring_size, OverflowPolicy::WRITE_THROUGH);
+  persistence_worker->SetPersistedCallback([plugin, storage_manager]() {
+    if (storage_manager->GetQueueSize() >= plugin->flush_at) {
+      request_flush(plugin);
+    }
+  });
+  persistence_worker->Start();
   
-  // Initialize feature flags manager
-  plugin->feature_flags_manager = new FeatureFlagsManager(plugin->http_client, plugin->storage_manager);
+  // Every upload path goes through the coordinator so rows are never sent twice at once
+  FlushCoordinator* flush_coordinator = new FlushCoordinator(storage_manager, http_client, plugin->max_batch_size);
   
-  // Initialize session replay manager if enabled
-  FlValue* session_replay_value = fl_value_lookup_string(args, "sessionReplay");
-  bool session_replay = false;
-  if (session_replay_value && fl_value_get_type(session_replay_value) == FL_VALUE_TYPE_BOOL) {
-    session_replay = fl_value_get_bool(session_replay_value);
+  // Initialize feature flags manager (loads cached flags from storage)
+  FeatureFlagsManager* feature_flags_manager = nullptr;
+  {
+    ScopedTimer timer("setup.flags_cache_load");
+    feature_flags_manager = new FeatureFlagsManager(http_client, storage_manager);
+    feature_flags_manager->SetExecutor(plugin->executor);
+    bootstrap_feature_flags(feature_flags_manager, options);
   }
   
-  plugin->session_replay_enabled = session_replay;
-  if (session_replay) {
+  // Initialize session replay manager if enabled
+  SessionReplayManager* session_replay_manager = nullptr;
+  if (options.session_replay) {
+    ScopedTimer timer("setup.session_replay_init");
     PostHogLogger::Debug("Initializing session replay...");
-    plugin->session_replay_manager = new SessionReplayManager(plugin->http_client, plugin->storage_manager, plugin->api_key);
-    plugin->session_replay_manager->SetActive(true);
-    plugin->session_replay_manager->SetDebug(plugin->debug);
+    session_replay_manager = new SessionReplayManager(http_client, storage_manager, plugin->api_key);
+    session_replay_manager->SetActive(true);
+    session_replay_manager->SetDebug(plugin->debug);
     
-    // Configure session replay settings
-    FlValue* replay_config_value = fl_value_lookup_string(args, "sessionReplayConfig");
-    if (replay_config_value && fl_value_get_type(replay_config_value) == FL_VALUE_TYPE_MAP) {
-      FlValue* quality_value = fl_value_lookup_string(replay_config_value, "compressionQuality");
-      if (quality_value && fl_value_get_type(quality_value) == FL_VALUE_TYPE_INT) {
-        plugin->session_replay_manager->SetCompressionQuality(fl_value_get_int(quality_value));
-      }
-      
-      FlValue* batch_size_value = fl_value_lookup_string(replay_config_value, "batchSize");
-      if (batch_size_value && fl_value_get_type(batch_size_value) == FL_VALUE_TYPE_INT) {
-        plugin->session_replay_manager->SetBatchSize(fl_value_get_int(batch_size_value));
-      }
-      
-      FlValue* batch_interval_value = fl_value_lookup_string(replay_config_value, "batchIntervalMs");
-      if (batch_interval_value && fl_value_get_type(batch_interval_value) == FL_VALUE_TYPE_INT) {
-        plugin->session_replay_manager->SetBatchInterval(fl_value_get_int(batch_interval_value));
-      }
-      
-      FlValue* max_dim_value = fl_value_lookup_string(replay_config_value, "maxImageDimension");
-      if (max_dim_value && fl_value_get_type(max_dim_value) == FL_VALUE_TYPE_INT) {
-        plugin->session_replay_manager->SetMaxImageDimension(fl_value_get_int(max_dim_value));
-      }
+    if (options.replay_compression_quality >= 0) {
+      session_replay_manager->SetCompressionQuality(options.replay_compression_quality);
+    }
+    if (options.replay_batch_size >= 0) {
+      session_replay_manager->SetBatchSize(options.replay_batch_size);
+    }
+    if (options.replay_batch_interval_ms >= 0) {
+      session_replay_manager->SetBatchInterval(options.replay_batch_interval_ms);
+    }
+    if (options.replay_max_image_dimension >= 0) {
+      session_replay_manager->SetMaxImageDimension(options.replay_max_image_dimension);
+    }
+    if (options.replay_keyframe_interval_ms >= 0) {
+      session_replay_manager->SetKeyframeInterval(options.replay_keyframe_interval_ms);
     }
   }
   
   // Set opt-out state
-  plugin->storage_manager->SetOptOut(plugin->opt_out);
+  storage_manager->SetOptOut(plugin->opt_out);
   
   // Get or create distinct ID
-  std::string distinct_id = get_or_create_distinct_id(plugin->storage_manager);
+  std::string distinct_id = get_or_create_distinct_id(storage_manager);
+  
+  feature_flags_manager->SetEvaluationContext(distinct_id, json::object());
   
   // Generate a new session ID each time the app starts (don't persist across app restarts)
-  std::string session_id = generate_uuid();
-  plugin->storage_manager->SetSessionId(session_id);
+  std::string session_id = posthog::GenerateUuid();
+  storage_manager->SetSessionId(session_id);
   
-  // Preload feature flags if enabled
-  FlValue* preload_flags_value = fl_value_lookup_string(args, "preloadFeatureFlags");
-  bool preload_flags = true;
-  if (preload_flags_value && fl_value_get_type(preload_flags_value) == FL_VALUE_TYPE_BOOL) {
-    preload_flags = fl_value_get_bool(preload_flags_value);
+  // Publish everything at once so main-thread handlers never see a half-built plugin.
+  // initialized is only set on the main context, after buffered calls are replayed.
+  {
+    std::lock_guard<std::mutex> lock(plugin->config_mutex);
+    plugin->storage_manager = storage_manager;
+    plugin->http_client = http_client;
+    plugin->persistence_worker = persistence_worker;
+    plugin->flush_coordinator = flush_coordinator;
+    plugin->feature_flags_manager = feature_flags_manager;
+    plugin->session_replay_manager = session_replay_manager;
+    plugin->session_replay_enabled = options.session_replay;
+    plugin->should_flush = true;
+    plugin->flush_thread = std::thread(flush_events_thread, plugin);
   }
   
-  if (preload_flags && !plugin->opt_out) {
-    std::map<std::string, std::string> properties;
-    plugin->feature_flags_manager->ReloadFeatureFlags(distinct_id, properties);
+  // Only now can a notification find the manager. Changes made during setup
+  // (bootstrap, cached identity) are already what Dart reads on first use.
+  if (plugin->notify_flag_changes) {
+    feature_flags_manager->SetFlagsChangedCallback([plugin](const std::vector<std::string>& changed_keys) {
+      post_flag_changes(plugin, changed_keys);
+    });
   }
   
-  plugin->initialized = true;
-  plugin->should_flush = true;
-  plugin->flush_thread = std::thread(flush_events_thread, plugin);
-  
   // Automatically send session initialization event to establish session context
   // This ensures PostHog recognizes the session and can link snapshot events
   posthog::PostHogEvent init_event;
@@ -470,16 +913,246 @@ static void handle_setup(PosthogFlutterPlugin* plugin, FlValue* args) {
   init_event.properties["$device_type"] = "Mobile";
   init_event.properties["$os"] = "Linux";
   
-  json init_event_json = init_event.to_json();
-  plugin->storage_manager->EnqueueEvent(init_event_json.dump());
+  enqueue_event(plugin, init_event);
   
   PostHogLogger::Debug("Session initialized with session_id: " + session_id);
   
   // Don't log API key for security - initialization is implicit
+  return distinct_id;
+}
+
+// Buffer a method call that arrived while setup was still running.
+// Returns false if the buffer is full and the call should be answered now.
+static bool buffer_pending_call(PosthogFlutterPlugin* plugin, FlMethodCall* method_call,
+                                int64_t timestamp_ms) {
+  if (plugin->pending_calls->size() >= static_cast<size_t>(plugin->max_queue_size)) {
+    PostHogMetrics::Increment("setup.dropped_calls");
+    return false;
+  }
+  g_object_ref(method_call);
+  plugin->pending_calls->push_back(PendingMethodCall{method_call, timestamp_ms});
+  return true;
+}
+
+// Log how long each startup phase took
+static void log_setup_phases() {
+  static const char* kPhases[] = {
+    "setup.storage_open", "setup.http_init", "setup.flags_cache_load",
+    "setup.session_replay_init", "setup.preload_flags", "setup.total",
+  };
+  std::string breakdown = "Setup phases (us):";
+  for (const char* phase : kPhases) {
+    PostHogMetrics::Stat stat = PostHogMetrics::Get(phase);
+    if (stat.count > 0) {
+      breakdown += std::string(" ") + (phase + strlen("setup.")) + "=" + std::to_string(stat.total);
+    }
+  }
+  PostHogLogger::Debug(breakdown);
+}
+
+// Handed from the setup task to the main context once initialization finishes
+struct SetupCompletion {
+  PosthogFlutterPlugin* plugin;
+  std::string distinct_id;
+  bool preload_flags;
+};
+
+// Preloading flags needs the network, so it is started only after setup has
+// completed and the buffered calls have been replayed
+static void preload_feature_flags(PosthogFlutterPlugin* plugin, const std::string& distinct_id) {
+  // No extra reference needed: dispose drains the executor before tearing anything down
+  int64_t start_us = PostHogMetrics::NowMicros();
+  std::map<std::string, std::string> properties;
+  plugin->feature_flags_manager->ReloadFeatureFlagsAsync(distinct_id, properties, [start_us](bool) {
+    PostHogMetrics::RecordDuration("setup.preload_flags", PostHogMetrics::NowMicros() - start_us);
+    log_setup_phases();
+  });
+}
+
+static void schedule_flag_refresh(PosthogFlutterPlugin* plugin, int64_t delay_ms);
+
+// Outcome of a background refresh, delivered back to the main context
+struct FlagRefreshResult {
+  PosthogFlutterPlugin* plugin;
+  bool success;
+};
+
+static gboolean finish_flag_refresh(gpointer user_data) {
+  FlagRefreshResult* result = static_cast<FlagRefreshResult*>(user_data);
+  PosthogFlutterPlugin* plugin = result->plugin;
+  if (result->success) {
+    plugin->flag_refresh_failures = 0;
+  } else {
+    plugin->flag_refresh_failures++;
+    PostHogMetrics::Increment("flags.refresh_failures");
+  }
+  schedule_flag_refresh(plugin, -1);
+  return G_SOURCE_REMOVE;
+}
+
+static void free_flag_refresh_result(gpointer user_data) {
+  FlagRefreshResult* result = static_cast<FlagRefreshResult*>(user_data);
+  g_object_unref(result->plugin);
+  delete result;
+}
+
+// Flags keep being served from the current snapshot while this runs; the
+// snapshot is only replaced once a newer response has been parsed.
+static gboolean on_flag_refresh_timer(gpointer user_data) {
+  PosthogFlutterPlugin* plugin = POSTHOG_FLUTTER_PLUGIN(user_data);
+  plugin->flag_refresh_source = 0;
+  
+  std::string distinct_id;
+  bool ready;
+  {
+    std::lock_guard<std::mutex> lock(plugin->config_mutex);
+    ready = plugin->initialized && !plugin->opt_out && plugin->feature_flags_manager && plugin->storage_manager;
+    if (ready) {
+      distinct_id = get_or_create_distinct_id(plugin->storage_manager);
+    }
+  }
+  
+  // schedule_flag_refresh takes config_mutex itself, so it is only called unlocked
+  if (!ready) {
+    schedule_flag_refresh(plugin, -1);
+    return G_SOURCE_REMOVE;
+  }
+  
+  // A reload from Dart since the timer was armed already revalidated the flags
+  int64_t age_ms = (PostHogMetrics::NowMicros() - plugin->feature_flags_manager->GetLastValidatedMicros()) / 1000;
+  int64_t interval_ms = static_cast<int64_t>(plugin->flag_refresh_interval_seconds) * 1000;
+  if (plugin->flag_refresh_failures == 0 && age_ms < interval_ms * (1.0 - kFlagRefreshJitter)) {
+    schedule_flag_refresh(plugin, interval_ms - age_ms);
+    return G_SOURCE_REMOVE;
+  }
+  
+  PostHogMetrics::Increment("flags.background_refreshes");
+  g_object_ref(plugin);
+  std::map<std::string, std::string> properties;
+  plugin->feature_flags_manager->ReloadFeatureFlagsAsync(distinct_id, properties, [plugin](bool success) {
+    g_main_context_invoke_full(nullptr, G_PRIORITY_DEFAULT, finish_flag_refresh,
+                               new FlagRefreshResult{plugin, success}, free_flag_refresh_result);
+  });
+  return G_SOURCE_REMOVE;
+}
+
+// Arm the refresh timer. With delay_ms < 0 the delay is the configured interval,
+// doubled for every consecutive failure of either flag refreshes or event uploads
+// (capped at kFlagRefreshMaxBackoffSeconds). Every delay is jittered. Takes
+// config_mutex, so callers must not hold it.
+static void schedule_flag_refresh(PosthogFlutterPlugin* plugin, int64_t delay_ms) {
+  if (plugin->flag_refresh_interval_seconds <= 0 || plugin->flag_refresh_source) {
+    return;
+  }
+  
+  double delay_seconds = delay_ms / 1000.0;
+  if (delay_ms < 0) {
+    int failures = plugin->flag_refresh_failures;
+    {
+      std::lock_guard<std::mutex> lock(plugin->config_mutex);
+      if (plugin->flush_coordinator) {
+        failures = std::max(failures, plugin->flush_coordinator->GetConsecutiveFailures());
+      }
+    }
+    
+    delay_seconds = plugin->flag_refresh_interval_seconds;
+    double max_delay_seconds = std::max(delay_seconds, kFlagRefreshMaxBackoffSeconds);
+    for (int i = 0; i < failures && delay_seconds < max_delay_seconds; i++) {
+      delay_seconds *= 2;
+    }
+    delay_seconds = std::min(delay_seconds, max_delay_seconds);
+  }
+  
+  static std::mt19937 random_engine(std::random_device{}());
+  std::uniform_real_distribution<double> jitter(1.0 - kFlagRefreshJitter, 1.0 + kFlagRefreshJitter);
+  double jittered_ms = std::min(delay_seconds * jitter(random_engine) * 1000, static_cast<double>(G_MAXUINT));
+  plugin->flag_refresh_source = g_timeout_add(static_cast<guint>(jittered_ms), on_flag_refresh_timer, plugin);
+}
+
+// Runs on the main context once initialize_plugin has finished: marks the
+// plugin ready and replays calls buffered during setup in arrival order.
+static gboolean finish_setup_on_main_context(gpointer user_data) {
+  SetupCompletion* completion = static_cast<SetupCompletion*>(user_data);
+  PosthogFlutterPlugin* plugin = completion->plugin;
+  {
+    std::lock_guard<std::mutex> lock(plugin->config_mutex);
+    plugin->initialized = !completion->distinct_id.empty();
+    plugin->initializing = false;
+  }
+  
+  std::vector<PendingMethodCall> pending;
+  pending.swap(*plugin->pending_calls);
+  for (const PendingMethodCall& call : pending) {
+    dispatch_method_call(plugin->channel, call.method_call, plugin, call.timestamp_ms);
+    g_object_unref(call.method_call);
+  }
+  if (!pending.empty()) {
+    PostHogMetrics::Increment("setup.replayed_calls", static_cast<int64_t>(pending.size()));
+    PostHogLogger::Debug("Replayed " + std::to_string(pending.size()) + " calls buffered during setup");
+  }
+  
+  if (plugin->initialized && !plugin->secure_api_key.empty() && plugin->executor) {
+    FeatureFlagsManager* feature_flags_manager = plugin->feature_flags_manager;
+    std::string secure_api_key = plugin->secure_api_key;
+    plugin->executor->Post([feature_flags_manager, secure_api_key]() {
+      ScopedTimer timer("flags.load_definitions");
+      feature_flags_manager->LoadFlagDefinitions(secure_api_key);
+    });
+  }
+  
+  if (plugin->initialized && completion->preload_flags && !plugin->opt_out) {
+    preload_feature_flags(plugin, completion->distinct_id);
+  } else {
+    log_setup_phases();
+  }
+  
+  if (plugin->initialized) {
+    schedule_flag_refresh(plugin, -1);
+  }
+  return G_SOURCE_REMOVE;
+}
+
+static void free_setup_completion(gpointer user_data) {
+  SetupCompletion* completion = static_cast<SetupCompletion*>(user_data);
+  g_object_unref(completion->plugin);
+  delete completion;
+}
+
+// Handle setup method. Arguments are parsed inline and the call is answered
+// immediately; initialization continues on the executor. Calls that arrive
+// in the meantime are buffered and replayed once it completes.
+static void handle_setup(PosthogFlutterPlugin* plugin, FlMethodCall* method_call, FlValue* args) {
+  SetupOptions options;
+  {
+    std::lock_guard<std::mutex> lock(plugin->config_mutex);
+    if (plugin->initialized || plugin->initializing || !parse_setup_args(plugin, args, options)) {
+      fl_method_call_respond_success(method_call, nullptr, nullptr);
+      return;
+    }
+    plugin->initializing = true;
+  }
+  
+  fl_method_call_respond_success(method_call, nullptr, nullptr);
+  
+  g_object_ref(plugin);
+  auto task = [plugin, options]() {
+    std::string distinct_id;
+    {
+      ScopedTimer timer("setup.total");
+      distinct_id = initialize_plugin(plugin, options);
+    }
+    SetupCompletion* completion = new SetupCompletion{plugin, distinct_id, options.preload_flags};
+    g_main_context_invoke_full(nullptr, G_PRIORITY_DEFAULT, finish_setup_on_main_context,
+                               completion, free_setup_completion);
+  };
+  
+  if (!plugin->executor || !plugin->executor->Post(task)) {
+    task();
+  }
 }
 
 // Handle capture method
-static void handle_capture(PosthogFlutterPlugin* plugin, FlValue* args) {
+static void handle_capture(PosthogFlutterPlugin* plugin, FlValue* args, int64_t timestamp_ms) {
   std::lock_guard<std::mutex> lock(plugin->config_mutex);
   
   if (!plugin->initialized || plugin->opt_out) {
@@ -496,8 +1169,9 @@ static void handle_capture(PosthogFlutterPlugin* plugin, FlValue* args) {
   // Build PostHog event using structs
   posthog::PostHogEvent event;
   event.event = event_name;
+  event.uuid = posthog::GenerateUuid();
   event.distinct_id = get_or_create_distinct_id(plugin->storage_manager);
-  event.timestamp = get_current_timestamp_ms();
+  event.timestamp = timestamp_ms;
   
   // Build properties JSON object
   json properties = json::object();
@@ -534,8 +1208,8 @@ static void handle_capture(PosthogFlutterPlugin* plugin, FlValue* args) {
   }
   
   // Add event properties from args
-  // Note: Flutter Linux FlValue API doesn't provide a way to enumerate map keys,
-  // so we manually extract known properties (especially $elements for autocapture)
+  // Known autocapture properties (especially $elements) are extracted explicitly,
+  // everything else goes through the generic converter below
   FlValue* properties_value = fl_value_lookup_string(args, "properties");
   if (properties_value && fl_value_get_type(properties_value) == FL_VALUE_TYPE_MAP) {
     // Manually extract $elements (autocapture) - this is critical for autocapture to work
@@ -582,66 +1256,47 @@ static void handle_capture(PosthogFlutterPlugin* plugin, FlValue* args) {
   
   event.properties = properties;
   
-  // Convert to JSON string for storage
-  json event_json_obj = event.to_json();
-  std::string event_json_str = event_json_obj.dump();
-  
-  // Sanitize for logging: remove API key if present, truncate if too long
-  std::string sanitized_json = event_json_str;
-  // Remove API key from JSON string if present
-  size_t api_key_pos = sanitized_json.find("\"api_key\"");
-  if (api_key_pos != std::string::npos) {
-    size_t start = sanitized_json.find('"', api_key_pos + 9);
-    size_t end = sanitized_json.find('"', start + 1);
-    if (end != std::string::npos) {
-      sanitized_json.replace(start + 1, end - start - 1, "***");
-    }
-  }
-  // Truncate if too long (show first and last 40 chars)
-  if (sanitized_json.length() > 80) {
-    sanitized_json = sanitized_json.substr(0, 40) + "..." + sanitized_json.substr(sanitized_json.length() - 40);
-  }
-  PostHogLogger::Debug("Event JSON: " + sanitized_json);
-  
-  // Enqueue event
-  plugin->storage_manager->EnqueueEvent(event_json_str);
-  
-  // Check if we should flush
-  int queue_size = plugin->storage_manager->GetQueueSize();
-  
-  if (queue_size >= plugin->flush_at) {
-    std::vector<std::string> events = plugin->storage_manager->GetQueuedEvents(plugin->max_batch_size);
-    std::vector<std::string> event_jsons;
-    std::vector<std::string> event_ids;
-    
-    for (const auto& event_with_id : events) {
-      size_t pos = event_with_id.find('|');
-      if (pos != std::string::npos) {
-        event_ids.push_back(event_with_id.substr(0, pos));
-        event_jsons.push_back(event_with_id.substr(pos + 1));
+  // Only build the sanitized preview when debug logging is on
+  if (PostHogLogger::GetLevel() >= LogLevel::DEBUG) {
+    // Sanitize for logging: remove API key if present, truncate if too long
+    std::string sanitized_json = event.to_json().dump();
+    // Remove API key from JSON string if present
+    size_t api_key_pos = sanitized_json.find("\"api_key\"");
+    if (api_key_pos != std::string::npos) {
+      size_t start = sanitized_json.find('"', api_key_pos + 9);
+      size_t end = sanitized_json.find('"', start + 1);
+      if (end != std::string::npos) {
+        sanitized_json.replace(start + 1, end - start - 1, "***");
       }
     }
-    
-    if (!event_jsons.empty()) {
-      HttpResponse response = plugin->http_client->PostCapture(event_jsons);
-      
-      // Only log errors - success is silent in production
-      if (!response.success) {
-        PostHogLogger::Error("Failed to send " + std::to_string(event_jsons.size()) + " events: HTTP " + std::to_string(response.status_code));
-        if (!response.body.empty()) {
-          PostHogLogger::Error("Response body: " + response.body);
-        }
-      }
-      
-      if (response.success) {
-        plugin->storage_manager->RemoveEvents(event_ids);
-      }
+    // Truncate if too long (show first and last 40 chars)
+    if (sanitized_json.length() > 80) {
+      sanitized_json = sanitized_json.substr(0, 40) + "..." + sanitized_json.substr(sanitized_json.length() - 40);
     }
+    PostHogLogger::Debug("Event JSON: " + sanitized_json);
+  }
+  
+  // The persistence worker writes it to SQLite and wakes the flush thread once
+  // the stored queue reaches flush_at
+  enqueue_event(plugin, event);
+}
+
+// Switch flags to a new identity: its cached flags (if any) are served at once
+// and revalidated in the background. Caller holds config_mutex.
+static void switch_flag_identity(PosthogFlutterPlugin* plugin, const std::string& distinct_id,
+                                 const json& person_properties) {
+  if (!plugin->feature_flags_manager) {
+    return;
+  }
+  plugin->feature_flags_manager->SetEvaluationContext(distinct_id, person_properties);
+  if (!plugin->opt_out) {
+    std::map<std::string, std::string> properties;
+    plugin->feature_flags_manager->ReloadFeatureFlagsAsync(distinct_id, properties, nullptr);
   }
 }
 
 // Handle identify method
-static void handle_identify(PosthogFlutterPlugin* plugin, FlValue* args) {
+static void handle_identify(PosthogFlutterPlugin* plugin, FlValue* args, int64_t timestamp_ms) {
   std::lock_guard<std::mutex> lock(plugin->config_mutex);
   
   if (!plugin->initialized || plugin->opt_out) {
@@ -656,11 +1311,19 @@ static void handle_identify(PosthogFlutterPlugin* plugin, FlValue* args) {
   std::string user_id = fl_value_get_string(user_id_value);
   plugin->storage_manager->SetDistinctId(user_id);
   
+  // Person properties let flags with property filters resolve locally right away
+  json user_properties = json::object();
+  FlValue* user_properties_value = fl_value_lookup_string(args, "userProperties");
+  if (user_properties_value && fl_value_get_type(user_properties_value) == FL_VALUE_TYPE_MAP) {
+    user_properties = fl_value_to_json_obj(user_properties_value);
+  }
+  switch_flag_identity(plugin, user_id, user_properties);
+  
   // Capture identify event using structs
   posthog::PostHogEvent event;
   event.event = "$identify";
   event.distinct_id = user_id;
-  event.timestamp = get_current_timestamp_ms();
+  event.timestamp = timestamp_ms;
   event.properties = json::object();
   
   // Add session_id to link events to session replay
@@ -672,12 +1335,15 @@ static void handle_identify(PosthogFlutterPlugin* plugin, FlValue* args) {
   // Add window_id to match session replay events
   event.properties["$window_id"] = "main";
   
-  json event_json_obj = event.to_json();
-  plugin->storage_manager->EnqueueEvent(event_json_obj.dump());
+  if (!user_properties.empty()) {
+    event.properties["$set"] = user_properties;
+  }
+  
+  enqueue_event(plugin, event);
 }
 
 // Handle screen method
-static void handle_screen(PosthogFlutterPlugin* plugin, FlValue* args) {
+static void handle_screen(PosthogFlutterPlugin* plugin, FlValue* args, int64_t timestamp_ms) {
   std::lock_guard<std::mutex> lock(plugin->config_mutex);
   
   if (!plugin->initialized || plugin->opt_out) {
@@ -695,7 +1361,7 @@ static void handle_screen(PosthogFlutterPlugin* plugin, FlValue* args) {
   posthog::PostHogEvent event;
   event.event = "$screen";
   event.distinct_id = get_or_create_distinct_id(plugin->storage_manager);
-  event.timestamp = get_current_timestamp_ms();
+  event.timestamp = timestamp_ms;
   event.properties["$screen_name"] = screen_name;
   
   // Add required PostHog library properties
@@ -716,29 +1382,145 @@ static void handle_screen(PosthogFlutterPlugin* plugin, FlValue* args) {
   // Add window_id to match session replay events
   event.properties["$window_id"] = "main";
   
-  json event_json_obj = event.to_json();
-  plugin->storage_manager->EnqueueEvent(event_json_obj.dump());
+  enqueue_event(plugin, event);
+}
+
+// Payloads stay raw JSON text until a flag's payload is first requested, so
+// large payloads that are never read cost no parse time. Returns a new
+// reference, or nullptr if there is no payload.
+static FlValue* lookup_flag_payload(PosthogFlutterPlugin* plugin, const std::string& flag_key,
+                                    const std::string& payload_json) {
+  if (payload_json.empty()) {
+    return nullptr;
+  }
+  
+  auto it = plugin->payload_cache->find(flag_key);
+  if (it != plugin->payload_cache->end() && it->second.payload_json == payload_json) {
+    PostHogMetrics::Increment("flags.payload_cache_hits");
+    return fl_value_ref(it->second.value);
+  }
+  
+  ScopedTimer timer("flags.payload_decode");
+  // Payloads are normally JSON documents; anything that isn't is returned as a plain string
+  json decoded = json::parse(payload_json, nullptr, false);
+  FlValue* value = decoded.is_discarded() ? fl_value_new_string(payload_json.c_str())
+                                          : json_to_fl_value(decoded);
+  if (it != plugin->payload_cache->end()) {
+    fl_value_unref(it->second.value);
+    it->second = DecodedPayload{payload_json, value};
+  } else {
+    plugin->payload_cache->emplace(flag_key, DecodedPayload{payload_json, value});
+  }
+  return fl_value_ref(value);
+}
+
+// Turn the exposures collected so far into $feature_flag_called events
+static void flush_flag_exposures(PosthogFlutterPlugin* plugin) {
+  std::vector<FlagExposureTracker::Exposure> exposures = plugin->exposure_tracker->TakePending();
+  if (exposures.empty()) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(plugin->config_mutex);
+  if (!plugin->initialized || plugin->opt_out || !plugin->storage_manager) {
+    return;
+  }
+
+  int64_t timestamp_ms = get_current_timestamp_ms();
+  std::string session_id = get_or_create_session_id(plugin->storage_manager);
+  for (FlagExposureTracker::Exposure& exposure : exposures) {
+    posthog::PostHogEvent event;
+    event.event = "$feature_flag_called";
+    event.distinct_id = exposure.distinct_id;
+    event.timestamp = timestamp_ms;
+    event.properties = json::object();
+    event.properties["$feature_flag"] = exposure.flag_key;
+    event.properties["$feature_flag_response"] = std::move(exposure.response);
+    event.properties["$lib"] = "posthog-flutter";
+    event.properties["$lib_version"] = "5.9.0";
+    event.properties["$os"] = "Linux";
+    if (!session_id.empty()) {
+      event.properties["$session_id"] = session_id;
+    }
+    event.properties["$window_id"] = "main";
+    enqueue_event(plugin, event);
+  }
+  PostHogMetrics::Increment("flags.exposures_sent", static_cast<int64_t>(exposures.size()));
+}
+
+static gboolean on_flag_exposure_timer(gpointer user_data) {
+  PosthogFlutterPlugin* plugin = POSTHOG_FLUTTER_PLUGIN(user_data);
+  plugin->exposure_flush_source = 0;
+  flush_flag_exposures(plugin);
+  return G_SOURCE_REMOVE;
+}
+
+// The $feature_flag_response for a GetFeatureFlag() value: the variant for
+// multivariate flags, a boolean for boolean flags and null for unknown flags
+static json flag_response_value(const std::string& value) {
+  return value.empty() ? json(nullptr)
+         : value == "true" ? json(true)
+         : value == "false" ? json(false)
+         : json(value);
+}
+
+// Report a flag read, at most once per (distinct_id, flag, value). Exposures are
+// sent in batches: when kFlagExposureBatchSize are pending, or after a short delay.
+static void track_flag_exposure(PosthogFlutterPlugin* plugin, const std::string& flag_key,
+                                const json& response) {
+  if (!plugin->send_feature_flag_events || !plugin->initialized || !plugin->storage_manager) {
+    return;
+  }
+
+  std::string distinct_id;
+  {
+    std::lock_guard<std::mutex> lock(plugin->config_mutex);
+    if (plugin->opt_out) {
+      return;
+    }
+    distinct_id = get_or_create_distinct_id(plugin->storage_manager);
+  }
+
+  if (!plugin->exposure_tracker->Record(distinct_id, flag_key, response)) {
+    PostHogMetrics::Increment("flags.exposures_deduped");
+    return;
+  }
+
+  if (plugin->exposure_tracker->GetPendingCount() >= kFlagExposureBatchSize) {
+    if (plugin->exposure_flush_source) {
+      g_source_remove(plugin->exposure_flush_source);
+      plugin->exposure_flush_source = 0;
+    }
+    flush_flag_exposures(plugin);
+  } else if (!plugin->exposure_flush_source) {
+    plugin->exposure_flush_source = g_timeout_add(kFlagExposureFlushDelayMs, on_flag_exposure_timer, plugin);
+  }
 }
 
 // Handle other methods
-static void handle_method_call(FlMethodChannel* channel, FlMethodCall* method_call,
-                               gpointer user_data) {
+static void dispatch_method_call(FlMethodChannel* channel, FlMethodCall* method_call,
+                                 gpointer user_data, int64_t timestamp_ms) {
   PosthogFlutterPlugin* plugin = POSTHOG_FLUTTER_PLUGIN(user_data);
   
   const gchar* method = fl_method_call_get_name(method_call);
   FlValue* args = fl_method_call_get_args(method_call);
   
+  // Until setup has finished, hold on to every other call so it runs in order afterwards
+  if (plugin->initializing && strcmp(method, "setup") != 0 &&
+      buffer_pending_call(plugin, method_call, timestamp_ms)) {
+    return;
+  }
+  
   if (strcmp(method, "setup") == 0) {
-    handle_setup(plugin, args);
-    fl_method_call_respond_success(method_call, nullptr, nullptr);
+    handle_setup(plugin, method_call, args);
   } else if (strcmp(method, "capture") == 0) {
-    handle_capture(plugin, args);
+    handle_capture(plugin, args, timestamp_ms);
     fl_method_call_respond_success(method_call, nullptr, nullptr);
   } else if (strcmp(method, "identify") == 0) {
-    handle_identify(plugin, args);
+    handle_identify(plugin, args, timestamp_ms);
     fl_method_call_respond_success(method_call, nullptr, nullptr);
   } else if (strcmp(method, "screen") == 0) {
-    handle_screen(plugin, args);
+    handle_screen(plugin, args, timestamp_ms);
     fl_method_call_respond_success(method_call, nullptr, nullptr);
   } else if (strcmp(method, "distinctId") == 0) {
     std::lock_guard<std::mutex> lock(plugin->config_mutex);
@@ -749,8 +1531,10 @@ static void handle_method_call(FlMethodChannel* channel, FlMethodCall* method_ca
   } else if (strcmp(method, "reset") == 0) {
     std::lock_guard<std::mutex> lock(plugin->config_mutex);
     if (plugin->storage_manager) {
-      std::string new_id = generate_uuid();
+      std::string new_id = posthog::GenerateUuid();
       plugin->storage_manager->SetDistinctId(new_id);
+      switch_flag_identity(plugin, new_id, json::object());
+      plugin->exposure_tracker->Clear();
       // Clear super properties
       auto super_props = plugin->storage_manager->GetAllSuperProperties();
       for (const auto& prop : super_props) {
@@ -819,36 +1603,38 @@ static void handle_method_call(FlMethodChannel* channel, FlMethodCall* method_ca
     }
     fl_method_call_respond_success(method_call, nullptr, nullptr);
   } else if (strcmp(method, "flush") == 0) {
-    std::lock_guard<std::mutex> lock(plugin->config_mutex);
-    if (plugin->initialized && !plugin->opt_out && plugin->storage_manager) {
-      std::vector<std::string> events = plugin->storage_manager->GetQueuedEvents(plugin->max_batch_size);
-      std::vector<std::string> event_jsons;
-      std::vector<std::string> event_ids;
-      
-      for (const auto& event_with_id : events) {
-        size_t pos = event_with_id.find('|');
-        if (pos != std::string::npos) {
-          event_ids.push_back(event_with_id.substr(0, pos));
-          event_jsons.push_back(event_with_id.substr(pos + 1));
-        }
+    // Upload runs on the executor; the call completes once the queue is drained
+    run_async(plugin, method_call, [](PosthogFlutterPlugin* plugin) -> FlValue* {
+      // Make sure events still in the ingestion queue are on disk before sending
+      if (plugin->persistence_worker) {
+        plugin->persistence_worker->WaitForDrain(std::chrono::seconds(2));
       }
-      
-      if (!event_jsons.empty() && plugin->http_client) {
-        HttpResponse response = plugin->http_client->PostCapture(event_jsons);
-        if (response.success) {
-          plugin->storage_manager->RemoveEvents(event_ids);
+      FlushCoordinator* flush_coordinator;
+      {
+        // Only hold the config lock while reading state, not during the upload
+        std::lock_guard<std::mutex> lock(plugin->config_mutex);
+        if (!plugin->initialized || plugin->opt_out || !plugin->flush_coordinator) {
+          return nullptr;
         }
+        flush_coordinator = plugin->flush_coordinator;
       }
-    }
-    fl_method_call_respond_success(method_call, nullptr, nullptr);
+      
+      // Joins an in-progress drain instead of racing it for the same rows
+      flush_coordinator->Flush();
+      return nullptr;
+    });
   } else if (strcmp(method, "isFeatureEnabled") == 0) {
     if (args && fl_value_get_type(args) == FL_VALUE_TYPE_MAP) {
       FlValue* key_value = fl_value_lookup_string(args, "key");
       if (key_value) {
-        std::lock_guard<std::mutex> lock(plugin->config_mutex);
+        // Flag reads go to an immutable snapshot and never take the config lock
         bool enabled = false;
-        if (plugin->feature_flags_manager) {
-          enabled = plugin->feature_flags_manager->IsFeatureEnabled(fl_value_get_string(key_value));
+        if (plugin->initialized && plugin->feature_flags_manager) {
+          // Resolve the full value so a multivariate flag reports its variant,
+          // the same exposure getFeatureFlag records for it
+          std::string value = plugin->feature_flags_manager->GetFeatureFlag(fl_value_get_string(key_value));
+          enabled = !value.empty() && value != "false";
+          track_flag_exposure(plugin, fl_value_get_string(key_value), flag_response_value(value));
         }
         g_autoptr(FlValue) result = fl_value_new_bool(enabled);
         fl_method_call_respond_success(method_call, result, nullptr);
@@ -861,10 +1647,10 @@ static void handle_method_call(FlMethodChannel* channel, FlMethodCall* method_ca
     if (args && fl_value_get_type(args) == FL_VALUE_TYPE_MAP) {
       FlValue* key_value = fl_value_lookup_string(args, "key");
       if (key_value) {
-        std::lock_guard<std::mutex> lock(plugin->config_mutex);
         std::string value;
-        if (plugin->feature_flags_manager) {
+        if (plugin->initialized && plugin->feature_flags_manager) {
           value = plugin->feature_flags_manager->GetFeatureFlag(fl_value_get_string(key_value));
+          track_flag_exposure(plugin, fl_value_get_string(key_value), flag_response_value(value));
         }
         g_autoptr(FlValue) result = value.empty() ? nullptr : fl_value_new_string(value.c_str());
         fl_method_call_respond_success(method_call, result, nullptr);
@@ -874,13 +1660,36 @@ static void handle_method_call(FlMethodChannel* channel, FlMethodCall* method_ca
     // Invalid args - respond with null result
     fl_method_call_respond_success(method_call, nullptr, nullptr);
   } else if (strcmp(method, "reloadFeatureFlags") == 0) {
-    std::lock_guard<std::mutex> lock(plugin->config_mutex);
-    if (plugin->initialized && !plugin->opt_out && plugin->feature_flags_manager && plugin->storage_manager) {
-      std::string distinct_id = get_or_create_distinct_id(plugin->storage_manager);
-      std::map<std::string, std::string> properties;
-      plugin->feature_flags_manager->ReloadFeatureFlags(distinct_id, properties);
+    std::string distinct_id;
+    {
+      std::lock_guard<std::mutex> lock(plugin->config_mutex);
+      if (!plugin->initialized || plugin->opt_out || !plugin->feature_flags_manager || !plugin->storage_manager) {
+        fl_method_call_respond_success(method_call, nullptr, nullptr);
+        return;
+      }
+      distinct_id = get_or_create_distinct_id(plugin->storage_manager);
     }
-    fl_method_call_respond_success(method_call, nullptr, nullptr);
+    // Optional subset of flags to evaluate (merged into the current flags)
+    std::vector<std::string> flag_keys;
+    FlValue* flag_keys_value = args && fl_value_get_type(args) == FL_VALUE_TYPE_MAP ?
+      fl_value_lookup_string(args, "flagKeys") : nullptr;
+    if (flag_keys_value && fl_value_get_type(flag_keys_value) == FL_VALUE_TYPE_LIST) {
+      for (size_t i = 0; i < fl_value_get_length(flag_keys_value); i++) {
+        FlValue* key_value = fl_value_get_list_value(flag_keys_value, i);
+        if (fl_value_get_type(key_value) == FL_VALUE_TYPE_STRING) {
+          flag_keys.push_back(fl_value_get_string(key_value));
+        }
+      }
+    }
+    
+    // Runs in the background and is merged with any identical reload in flight;
+    // the call completes once the new flags have been swapped in
+    g_object_ref(plugin);
+    g_object_ref(method_call);
+    std::map<std::string, std::string> properties;
+    plugin->feature_flags_manager->ReloadFeatureFlagsAsync(distinct_id, properties,
+        [plugin, method_call](bool) { respond_from_main_context(plugin, method_call, nullptr); },
+        flag_keys);
   } else if (strcmp(method, "getSessionId") == 0) {
     std::lock_guard<std::mutex> lock(plugin->config_mutex);
     std::string session_id;
@@ -898,7 +1707,7 @@ static void handle_method_call(FlMethodChannel* channel, FlMethodCall* method_ca
     }
     
     // Generate a new session ID
-    std::string session_id = generate_uuid();
+    std::string session_id = posthog::GenerateUuid();
     plugin->storage_manager->SetSessionId(session_id);
     
     // Send session initialization event to establish new session context
@@ -906,7 +1715,7 @@ static void handle_method_call(FlMethodChannel* channel, FlMethodCall* method_ca
     posthog::PostHogEvent init_event;
     init_event.event = "$screen";
     init_event.distinct_id = distinct_id;
-    init_event.timestamp = get_current_timestamp_ms();
+    init_event.timestamp = timestamp_ms;
     init_event.properties["$screen_name"] = "Session Started";
     init_event.properties["$session_id"] = session_id;
     init_event.properties["$window_id"] = "main";
@@ -915,8 +1724,7 @@ static void handle_method_call(FlMethodChannel* channel, FlMethodCall* method_ca
     init_event.properties["$device_type"] = "Mobile";
     init_event.properties["$os"] = "Linux";
     
-    json init_event_json = init_event.to_json();
-    plugin->storage_manager->EnqueueEvent(init_event_json.dump());
+    enqueue_event(plugin, init_event);
     
     PostHogLogger::Debug("New session created with session_id: " + session_id);
     
@@ -943,13 +1751,16 @@ static void handle_method_call(FlMethodChannel* channel, FlMethodCall* method_ca
           posthog::PostHogEvent event;
           event.event = "$create_alias";
           event.distinct_id = new_id;
-          event.timestamp = get_current_timestamp_ms();
+          event.timestamp = timestamp_ms;
           event.properties = json::object();
           event.properties["alias"] = old_id;
           
-          json event_json_obj = event.to_json();
-          plugin->storage_manager->EnqueueEvent(event_json_obj.dump());
+          enqueue_event(plugin, event);
           plugin->storage_manager->SetDistinctId(new_id);
+          // Same person under a new id, so its properties carry over
+          if (plugin->feature_flags_manager) {
+            switch_flag_identity(plugin, new_id, plugin->feature_flags_manager->GetPersonProperties());
+          }
         }
       }
     }
@@ -965,12 +1776,11 @@ static void handle_method_call(FlMethodChannel* channel, FlMethodCall* method_ca
           posthog::PostHogEvent event;
           event.event = "$groupidentify";
           event.distinct_id = get_or_create_distinct_id(plugin->storage_manager);
-          event.timestamp = get_current_timestamp_ms();
+          event.timestamp = timestamp_ms;
           event.properties["$group_type"] = fl_value_get_string(group_type_value);
           event.properties["$group_key"] = fl_value_get_string(group_key_value);
           
-          json event_json_obj = event.to_json();
-          plugin->storage_manager->EnqueueEvent(event_json_obj.dump());
+          enqueue_event(plugin, event);
         }
       }
     }
@@ -985,11 +1795,10 @@ static void handle_method_call(FlMethodChannel* channel, FlMethodCall* method_ca
         posthog::PostHogEvent event;
         event.event = "$exception";
         event.distinct_id = get_or_create_distinct_id(plugin->storage_manager);
-        event.timestamp = get_current_timestamp_ms();
+        event.timestamp = timestamp_ms;
         event.properties = json::object();
         
-        json event_json_obj = event.to_json();
-        plugin->storage_manager->EnqueueEvent(event_json_obj.dump());
+        enqueue_event(plugin, event);
       }
     }
     fl_method_call_respond_success(method_call, nullptr, nullptr);
@@ -997,28 +1806,52 @@ static void handle_method_call(FlMethodChannel* channel, FlMethodCall* method_ca
     if (args && fl_value_get_type(args) == FL_VALUE_TYPE_MAP) {
       FlValue* key_value = fl_value_lookup_string(args, "key");
       if (key_value) {
-        std::lock_guard<std::mutex> lock(plugin->config_mutex);
-        std::string payload;
-        if (plugin->feature_flags_manager) {
-          payload = plugin->feature_flags_manager->GetFeatureFlagPayload(fl_value_get_string(key_value));
+        g_autoptr(FlValue) result = nullptr;
+        if (plugin->initialized && plugin->feature_flags_manager) {
+          std::string flag_key = fl_value_get_string(key_value);
+          result = lookup_flag_payload(plugin, flag_key, plugin->feature_flags_manager->GetFeatureFlagPayload(flag_key));
         }
-        g_autoptr(FlValue) result = payload.empty() ? nullptr : fl_value_new_string(payload.c_str());
         fl_method_call_respond_success(method_call, result, nullptr);
         return;
       }
     }
     // Invalid args - respond with null result
     fl_method_call_respond_success(method_call, nullptr, nullptr);
+  } else if (strcmp(method, "getAllFeatureFlagsAndPayloads") == 0) {
+    // Whole snapshot in one round trip: {featureFlags: {key: bool|variant}, featureFlagPayloads: {key: payload}}
+    g_autoptr(FlValue) flags = fl_value_new_map();
+    g_autoptr(FlValue) payloads = fl_value_new_map();
+    if (plugin->initialized && plugin->feature_flags_manager) {
+      for (const auto& entry : plugin->feature_flags_manager->GetAllFlags()) {
+        const posthog::FeatureFlagValue& flag = entry.second;
+        fl_value_set_string_take(flags, entry.first.c_str(),
+                                 flag.variant.empty() ? fl_value_new_bool(flag.enabled)
+                                                      : fl_value_new_string(flag.variant.c_str()));
+        FlValue* payload = lookup_flag_payload(plugin, entry.first, flag.payload_json);
+        if (payload) {
+          fl_value_set_string_take(payloads, entry.first.c_str(), payload);
+        }
+      }
+    }
+    g_autoptr(FlValue) result = fl_value_new_map();
+    fl_value_set_string(result, "featureFlags", flags);
+    fl_value_set_string(result, "featureFlagPayloads", payloads);
+    fl_method_call_respond_success(method_call, result, nullptr);
   } else if (strcmp(method, "close") == 0) {
     {
       std::lock_guard<std::mutex> lock(plugin->config_mutex);
       plugin->should_flush = false;
     }
-    fl_method_call_respond_success(method_call, nullptr, nullptr);
-    // Join thread after releasing lock
-    if (plugin->flush_thread.joinable()) {
-      plugin->flush_thread.join();
-    }
+    plugin->flush_cv.notify_all();
+    // The flush thread may be mid-upload; join it off the main loop
+    run_async(plugin, method_call, [](PosthogFlutterPlugin* plugin) -> FlValue* {
+      // Join thread after releasing lock
+      if (plugin->flush_thread.joinable()) {
+        plugin->flush_thread.join();
+      }
+      PostHogMetrics::LogSummary();
+      return nullptr;
+    });
   } else if (strcmp(method, "sendFullSnapshot") == 0) {
     if (args && fl_value_get_type(args) == FL_VALUE_TYPE_MAP && plugin->session_replay_manager) {
       FlValue* image_bytes_value = fl_value_lookup_string(args, "imageBytes");
@@ -1044,20 +1877,64 @@ static void handle_method_call(FlMethodChannel* channel, FlMethodCall* method_ca
                     + ", size=" + std::to_string(data_length) + " bytes, dimensions=" 
                     + std::to_string(fl_value_get_int(width_value)) + "x" + std::to_string(fl_value_get_int(height_value)));
         
-        plugin->session_replay_manager->AddSnapshot(
-          image_data,
-          fl_value_get_int(id_value),
-          fl_value_get_int(x_value),
-          fl_value_get_int(y_value),
-          fl_value_get_int(width_value),
-          fl_value_get_int(height_value)
-        );
+        // Only the copy happens here; encoding runs on the replay encode pool
+        plugin->session_replay_manager->AddSnapshot(std::move(image_data),
+                                                    fl_value_get_int(id_value),
+                                                    fl_value_get_int(x_value),
+                                                    fl_value_get_int(y_value),
+                                                    fl_value_get_int(width_value),
+                                                    fl_value_get_int(height_value));
+      }
+    }
+    fl_method_call_respond_success(method_call, nullptr, nullptr);
+  } else if (strcmp(method, "sendRawSnapshot") == 0) {
+    if (args && fl_value_get_type(args) == FL_VALUE_TYPE_MAP && plugin->session_replay_manager) {
+      FlValue* image_bytes_value = fl_value_lookup_string(args, "imageBytes");
+      FlValue* image_width_value = fl_value_lookup_string(args, "imageWidth");
+      FlValue* image_height_value = fl_value_lookup_string(args, "imageHeight");
+      FlValue* stride_value = fl_value_lookup_string(args, "stride");
+      FlValue* id_value = fl_value_lookup_string(args, "id");
+      FlValue* x_value = fl_value_lookup_string(args, "x");
+      FlValue* y_value = fl_value_lookup_string(args, "y");
+      FlValue* width_value = fl_value_lookup_string(args, "width");
+      FlValue* height_value = fl_value_lookup_string(args, "height");
+      
+      if (image_bytes_value && image_width_value && image_height_value && stride_value &&
+          id_value && x_value && y_value && width_value && height_value &&
+          fl_value_get_type(image_bytes_value) == FL_VALUE_TYPE_UINT8_LIST &&
+          fl_value_get_type(image_width_value) == FL_VALUE_TYPE_INT &&
+          fl_value_get_type(image_height_value) == FL_VALUE_TYPE_INT &&
+          fl_value_get_type(stride_value) == FL_VALUE_TYPE_INT &&
+          fl_value_get_type(id_value) == FL_VALUE_TYPE_INT &&
+          fl_value_get_type(x_value) == FL_VALUE_TYPE_INT &&
+          fl_value_get_type(y_value) == FL_VALUE_TYPE_INT &&
+          fl_value_get_type(width_value) == FL_VALUE_TYPE_INT &&
+          fl_value_get_type(height_value) == FL_VALUE_TYPE_INT) {
         
-        fl_method_call_respond_success(method_call, nullptr, nullptr);
-        return;
+        const uint8_t* data = fl_value_get_uint8_list(image_bytes_value);
+        size_t data_length = fl_value_get_length(image_bytes_value);
+        
+        std::vector<uint8_t> rgba_data(data, data + data_length);
+        PostHogLogger::Debug("[Replay] Received raw snapshot: id=" + std::to_string(fl_value_get_int(id_value))
+                    + ", size=" + std::to_string(data_length) + " bytes, pixels="
+                    + std::to_string(fl_value_get_int(image_width_value)) + "x"
+                    + std::to_string(fl_value_get_int(image_height_value)));
+        
+        plugin->session_replay_manager->AddRawSnapshot(std::move(rgba_data),
+                                                       fl_value_get_int(image_width_value),
+                                                       fl_value_get_int(image_height_value),
+                                                       fl_value_get_int(stride_value),
+                                                       fl_value_get_int(id_value),
+                                                       fl_value_get_int(x_value),
+                                                       fl_value_get_int(y_value),
+                                                       fl_value_get_int(width_value),
+                                                       fl_value_get_int(height_value));
       }
     }
     fl_method_call_respond_success(method_call, nullptr, nullptr);
+  } else if (strcmp(method, "supportsRawSnapshot") == 0) {
+    g_autoptr(FlValue) result = fl_value_new_bool(SessionReplayManager::SupportsRawSnapshots());
+    fl_method_call_respond_success(method_call, result, nullptr);
   } else if (strcmp(method, "sendMetaEvent") == 0) {
     if (args && fl_value_get_type(args) == FL_VALUE_TYPE_MAP && plugin->session_replay_manager) {
       FlValue* width_value = fl_value_lookup_string(args, "width");
@@ -1101,6 +1978,21 @@ static void handle_method_call(FlMethodChannel* channel, FlMethodCall* method_ca
   }
 }
 
+// Entry point for all method calls: dispatches and records how long the main loop was blocked
+static void handle_method_call(FlMethodChannel* channel, FlMethodCall* method_call,
+                               gpointer user_data) {
+  std::string method = fl_method_call_get_name(method_call);
+  int64_t start_us = PostHogMetrics::NowMicros();
+  
+  dispatch_method_call(channel, method_call, user_data, get_current_timestamp_ms());
+  
+  int64_t stall_us = PostHogMetrics::NowMicros() - start_us;
+  PostHogMetrics::RecordDuration("main_loop." + method, stall_us);
+  if (stall_us > kMainLoopStallWarningUs) {
+    PostHogLogger::Debug("Method " + method + " blocked the main loop for " + std::to_string(stall_us / 1000) + " ms");
+  }
+}
+
 void posthog_flutter_plugin_register_with_registrar(FlPluginRegistrar* registrar) {
   PosthogFlutterPlugin* plugin = POSTHOG_FLUTTER_PLUGIN(
       g_object_new(posthog_flutter_plugin_get_type(), nullptr));
@@ -0,0 +1,26 @@
+#include "posthog_metrics.h"
+#include "posthog_logger.h"
+
+std::mutex PostHogMetrics::mutex_;
+std::map<std::string, PostHogMetrics::Stat> PostHogMetrics::stats_;
+
+void PostHogMetrics::LogSummary() {
+  if (PostHogLogger::GetLevel() < LogLevel::DEBUG) {
+    return;
+  }
+
+  std::map<std::string, Stat> snapshot;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    snapshot = stats_;
+  }
+
+  PostHogLogger::Debug("[Metrics] " + std::to_string(snapshot.size()) + " metrics");
+  for (const auto& [name, stat] : snapshot) {
+    int64_t avg = stat.count > 0 ? stat.total / stat.count : 0;
+    PostHogLogger::Debug("[Metrics] " + name + ": count=" + std::to_string(stat.count)
+                         + " total=" + std::to_string(stat.total)
+                         + " avg=" + std::to_string(avg)
+                         + " max=" + std::to_string(stat.max));
+  }
+}
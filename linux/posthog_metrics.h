@@ -0,0 +1,72 @@
+#ifndef POSTHOG_METRICS_H
+#define POSTHOG_METRICS_H
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+// Lightweight in-process counters and timings used to observe the plugin's
+// performance (main-loop stalls, startup phases, flush behaviour, ...).
+// Summaries are written to the debug log; nothing is sent to PostHog.
+class PostHogMetrics {
+public:
+  struct Stat {
+    int64_t count = 0;
+    int64_t total = 0;
+    int64_t max = 0;
+  };
+
+  // Record one sample of a duration in microseconds
+  static void RecordDuration(const std::string& name, int64_t duration_us) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stat& stat = stats_[name];
+    stat.count++;
+    stat.total += duration_us;
+    if (duration_us > stat.max) {
+      stat.max = duration_us;
+    }
+  }
+
+  // Add to a counter
+  static void Increment(const std::string& name, int64_t delta = 1) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stat& stat = stats_[name];
+    stat.count++;
+    stat.total += delta;
+  }
+
+  static Stat Get(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = stats_.find(name);
+    return it == stats_.end() ? Stat() : it->second;
+  }
+
+  // Log all metrics at debug level, one line per metric
+  static void LogSummary();
+
+  static int64_t NowMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+private:
+  static std::mutex mutex_;
+  static std::map<std::string, Stat> stats_;
+};
+
+// Records the lifetime of a scope as a duration sample
+class ScopedTimer {
+public:
+  explicit ScopedTimer(const std::string& name) : name_(name), start_us_(PostHogMetrics::NowMicros()) {}
+  ~ScopedTimer() { PostHogMetrics::RecordDuration(name_, ElapsedMicros()); }
+
+  int64_t ElapsedMicros() const { return PostHogMetrics::NowMicros() - start_us_; }
+
+private:
+  std::string name_;
+  int64_t start_us_;
+};
+
+#endif // POSTHOG_METRICS_H
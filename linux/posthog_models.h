@@ -13,6 +13,7 @@ namespace posthog {
 
 // PostHog event structure
 struct PostHogEvent {
+  std::string uuid;  // UUIDv7, lets PostHog dedupe retried uploads
   std::string event;
   std::string distinct_id;
   int64_t timestamp;
@@ -20,6 +21,9 @@ struct PostHogEvent {
   
   json to_json() const {
     json j;
+    if (!uuid.empty()) {
+      j["uuid"] = uuid;
+    }
     j["event"] = event;
     j["distinct_id"] = distinct_id;
     j["timestamp"] = std::to_string(timestamp);
@@ -67,7 +71,9 @@ struct SessionReplayWireframe {
     j["width"] = width;
     j["height"] = height;
     j["type"] = type;
-    j["base64"] = base64;
+    if (!base64.empty()) {
+      j["base64"] = base64;
+    }
     j["style"] = style;
     return j;
   }
@@ -106,6 +112,38 @@ struct SessionReplaySnapshotEvent {
   }
 };
 
+// Incremental snapshot data (mutation source): wireframes added under an
+// existing parent wireframe
+struct SessionReplayMutationData {
+  int parentId;
+  std::vector<SessionReplayWireframe> adds;
+  
+  json to_json() const {
+    json j;
+    j["source"] = 0;  // Mutation
+    j["adds"] = json::array();
+    for (const auto& wireframe : adds) {
+      j["adds"].push_back(json{{"parentId", parentId}, {"wireframe", wireframe.to_json()}});
+    }
+    return j;
+  }
+};
+
+// Session replay incremental snapshot event structure
+struct SessionReplayIncrementalEvent {
+  int type = 3;  // Incremental snapshot
+  SessionReplayMutationData data;
+  int64_t timestamp;
+  
+  json to_json() const {
+    json j;
+    j["type"] = type;
+    j["data"] = data.to_json();
+    j["timestamp"] = timestamp;
+    return j;
+  }
+};
+
 // Session replay event structure
 struct SessionReplayEvent {
   std::string event;
@@ -146,11 +184,19 @@ struct SessionReplayBatch {
   }
 };
 
+// One evaluated feature flag as returned by /decide/
+struct FeatureFlagValue {
+  bool enabled = false;
+  std::string variant;       // Multivariate variant key, empty for boolean flags
+  std::string payload_json;  // Raw JSON payload, empty if the flag has none
+};
+
 // Feature flags decide payload structure
 struct PostHogDecidePayload {
   std::string api_key;
   std::string distinct_id;
   json properties;
+  std::vector<std::string> flag_keys_to_evaluate;  // Empty evaluates every flag
   
   json to_json() const {
     json j;
@@ -159,6 +205,9 @@ struct PostHogDecidePayload {
     if (!properties.empty()) {
       j["properties"] = properties;
     }
+    if (!flag_keys_to_evaluate.empty()) {
+      j["flag_keys_to_evaluate"] = flag_keys_to_evaluate;
+    }
     return j;
   }
   
@@ -1,8 +1,15 @@
 #include "session_replay_manager.h"
+#include "base64.h"
+#include "content_hash.h"
 #include "http_client.h"
+#include "image_downscaler.h"
+#include "jpeg_encoder.h"
 #include "storage_manager.h"
 #include "posthog_models.h"
 #include "posthog_logger.h"
+#include "posthog_metrics.h"
+#include "task_executor.h"
+#include "uuid_generator.h"
 #include <cstring>
 #include <algorithm>
 #include <sstream>
@@ -10,38 +17,106 @@
 #include <iostream>
 #include <cmath>
 #include <vector>
-#include <random>
 #include <chrono>
+#include <iterator>
 
 using json = nlohmann::json;
 
 #ifdef HAVE_JPEG
 #include <png.h>
-#include <jpeglib.h>
-#include <setjmp.h>
 #endif
 
-// Base64 encoding table
-static const char base64_chars[] = 
-    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+// Upper bound on encode workers; frames are independent, so they encode in parallel
+static const size_t kMaxEncodeThreads = 4;
+
+// Frames queued or encoding at once. Beyond this the newest frame is dropped
+// rather than letting decoded screenshots pile up in memory.
+static const size_t kMaxPendingSnapshots = 8;
+
+// How long Flush() waits for in-flight frames before sending what is buffered
+static const int kFlushEncodeWaitMs = 2000;
+
+// Full frames go out at least this often, so a lost batch leaves the replay
+// wrong for a bounded time
+static const int kDefaultKeyframeIntervalMs = 30000;
+
+// Largest raw frame side accepted, the JPEG format's own limit
+static const int64_t kMaxRawSnapshotDimension = 65535;
+
+// Wireframe ids for the tile layer and its tiles. Screenshot ids come from
+// Dart's identityHashCode (30 bits on the VM), so these stay clear of them.
+static const int kTileLayerId = 2000000000;
+static const int kMaxTileIds = 100000000;
+
+// Stand-in for a frame's base64 in the serialized batch. The per-batch nonce
+// keeps user-supplied strings (distinct_id, screen names) from ever matching.
+static std::string ImagePlaceholder(const std::string& nonce, size_t index) {
+  return "$replay_image:" + nonce + ":" + std::to_string(index);
+}
+
+// Swap each placeholder in the serialized batch for its frame's base64,
+// encoding straight into a payload buffer that is sized once up front
+static std::string SpliceImages(const std::string& json, const std::vector<const std::vector<uint8_t>*>& images,
+                                const std::vector<std::string>& placeholders) {
+  size_t total = json.size();
+  for (size_t i = 0; i < images.size(); i++) {
+    total += posthog::Base64EncodedSize(images[i]->size());
+    total -= placeholders[i].size();
+  }
+
+  std::string payload;
+  payload.reserve(total);
+  size_t pos = 0;
+  for (size_t i = 0; i < images.size(); i++) {
+    size_t found = json.find(placeholders[i], pos);
+    if (found == std::string::npos) {
+      PostHogLogger::Error("[Replay] Snapshot placeholder missing from batch payload");
+      continue;
+    }
+    payload.append(json, pos, found - pos);
+    posthog::Base64Append(images[i]->data(), images[i]->size(), payload);
+    pos = found + placeholders[i].size();
+  }
+  payload.append(json, pos, std::string::npos);
+  return payload;
+}
+
+static size_t EncodeThreadCount() {
+  size_t cores = std::thread::hardware_concurrency();
+  // Leave headroom for the raster and UI threads
+  size_t threads = cores > 2 ? cores / 2 : 1;
+  return std::min(threads, kMaxEncodeThreads);
+}
 
 SessionReplayManager::SessionReplayManager(HttpClient* http_client, StorageManager* storage_manager, const std::string& api_key)
     : http_client_(http_client),
       storage_manager_(storage_manager),
       api_key_(api_key),
+      encode_executor_(new TaskExecutor(EncodeThreadCount())),
+      next_sequence_(0),
+      last_frame_hash_(0),
+      has_last_frame_(false),
       should_flush_(true),
       is_active_(false),
       compression_quality_(75),
       batch_size_(10),
       batch_interval_ms_(5000),
       max_image_dimension_(0),
+      keyframe_interval_ms_(kDefaultKeyframeIntervalMs),
       debug_(false),
-      meta_event_sent_(false) {
+      meta_event_sent_(false),
+      diff_sequence_(0),
+      keyframe_requested_(false),
+      last_keyframe_time_(0),
+      next_tile_id_(0) {
   last_batch_time_ = std::chrono::steady_clock::now();
   flush_thread_ = std::thread(&SessionReplayManager::FlushThread, this);
 }
 
 SessionReplayManager::~SessionReplayManager() {
+  // Finish in-flight encodes; they only touch the buffer, not the HTTP client
+  encode_executor_->Shutdown();
+
   // Stop the background thread first
   {
     std::lock_guard<std::mutex> lock(buffer_mutex_);
@@ -63,68 +138,7 @@ SessionReplayManager::~SessionReplayManager() {
   // Any remaining snapshots will be lost, but that's better than crashing
 }
 
-std::string SessionReplayManager::Base64Encode(const std::vector<uint8_t>& data) {
-  std::stringstream ss;
-  size_t i = 0;
-  
-  for (i = 0; i < data.size() - 2; i += 3) {
-    uint32_t b = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
-    ss << base64_chars[(b >> 18) & 0x3F];
-    ss << base64_chars[(b >> 12) & 0x3F];
-    ss << base64_chars[(b >> 6) & 0x3F];
-    ss << base64_chars[b & 0x3F];
-  }
-  
-  if (i < data.size()) {
-    uint32_t b = data[i] << 16;
-    if (i + 1 < data.size()) {
-      b |= data[i + 1] << 8;
-    }
-    ss << base64_chars[(b >> 18) & 0x3F];
-    ss << base64_chars[(b >> 12) & 0x3F];
-    if (i + 1 < data.size()) {
-      ss << base64_chars[(b >> 6) & 0x3F];
-    } else {
-      ss << '=';
-    }
-    ss << '=';
-  }
-  
-  return ss.str();
-}
-
-std::vector<uint8_t> SessionReplayManager::ResizeImage(
-    const std::vector<uint8_t>& image_data, 
-    int original_width, 
-    int original_height,
-    int& new_width, 
-    int& new_height) {
-  
-  if (max_image_dimension_ <= 0 || 
-      (original_width <= max_image_dimension_ && original_height <= max_image_dimension_)) {
-    new_width = original_width;
-    new_height = original_height;
-    return image_data;
-  }
-  
-  // Simple nearest-neighbor resize (for simplicity - could use better algorithm)
-  double scale = std::min(
-      static_cast<double>(max_image_dimension_) / original_width,
-      static_cast<double>(max_image_dimension_) / original_height
-  );
-  
-  new_width = static_cast<int>(original_width * scale);
-  new_height = static_cast<int>(original_height * scale);
-  
-  // For now, return original (full resize implementation would go here)
-  // This is a placeholder - full implementation would decode PNG, resize, re-encode
-  new_width = original_width;
-  new_height = original_height;
-  return image_data;
-}
-
-// Simple PNG header parser to extract dimensions (fallback when libpng not available)
-// Only handles non-interlaced PNGs (most common case)
+// Simple PNG header parser to extract dimensions from the IHDR chunk
 [[maybe_unused]] static bool ParsePngDimensions(const std::vector<uint8_t>& png_data, int& width, int& height) {
   // PNG signature: 89 50 4E 47 0D 0A 1A 0A
   if (png_data.size() < 24) return false;
@@ -142,17 +156,34 @@ std::vector<uint8_t> SessionReplayManager::ResizeImage(
 }
 
 #ifdef HAVE_JPEG
-// Error handling for JPEG compression
-struct jpeg_error_mgr jerr;
-static void jpeg_error_exit(j_common_ptr cinfo) {
-  (*cinfo->err->output_message)(cinfo);
-  longjmp(*(jmp_buf*)cinfo->client_data, 1);
+// Decode PNG into one contiguous RGBA buffer (rows width * 4 bytes apart)
+static bool DecodePngToRgba(const std::vector<uint8_t>& png_data,
+                            std::vector<uint8_t>& rgba_data,
+                            int& width, int& height) {
+  png_image image;
+  memset(&image, 0, sizeof(image));
+  image.version = PNG_IMAGE_VERSION;
+  
+  if (!png_image_begin_read_from_memory(&image, png_data.data(), png_data.size())) {
+    return false;
+  }
+  
+  // libpng expands palette, grayscale and 16-bit input to 8-bit RGBA
+  image.format = PNG_FORMAT_RGBA;
+  rgba_data.resize(PNG_IMAGE_SIZE(image));
+  if (!png_image_finish_read(&image, nullptr, rgba_data.data(), 0, nullptr)) {
+    png_image_free(&image);
+    return false;
+  }
+  
+  width = image.width;
+  height = image.height;
+  return true;
 }
 
-// Decode PNG to RGB data
-static bool DecodePngToRgb(const std::vector<uint8_t>& png_data, 
-                           std::vector<uint8_t>& rgb_data,
-                           int& width, int& height) {
+// Decode PNG row by row straight into the downscaler, so only one
+// full-resolution row is ever held. Needs a non-interlaced PNG.
+static bool DecodePngScaled(const std::vector<uint8_t>& png_data, ImageDownscaler& scaler, int width) {
   png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
   if (!png_ptr) return false;
   
@@ -162,21 +193,21 @@ static bool DecodePngToRgb(const std::vector<uint8_t>& png_data,
     return false;
   }
   
-  // Set up error handling
-  if (setjmp(png_jmpbuf(png_ptr))) {
-    png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
-    return false;
-  }
+  // Allocated before setjmp so a libpng error can't skip its destructor
+  std::vector<uint8_t> row(static_cast<size_t>(width) * 4);
   
-  // Create a memory reader
   struct PngReadData {
     const uint8_t* data;
     size_t size;
     size_t offset;
   };
-  
   PngReadData read_data = {png_data.data(), png_data.size(), 0};
   
+  if (setjmp(png_jmpbuf(png_ptr))) {
+    png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
+    return false;
+  }
+  
   png_set_read_fn(png_ptr, &read_data, 
                   [](png_structp png_ptr, png_bytep data, png_size_t length) {
                     auto* rd = static_cast<PngReadData*>(png_get_io_ptr(png_ptr));
@@ -190,10 +221,13 @@ static bool DecodePngToRgb(const std::vector<uint8_t>& png_data,
   
   png_read_info(png_ptr, info_ptr);
   
-  width = png_get_image_width(png_ptr, info_ptr);
-  height = png_get_image_height(png_ptr, info_ptr);
+  if (static_cast<int>(png_get_image_width(png_ptr, info_ptr)) != width ||
+      png_get_interlace_type(png_ptr, info_ptr) != PNG_INTERLACE_NONE) {
+    png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
+    return false;
+  }
   
-  // Convert to RGB if needed
+  // Convert to 8-bit RGBA
   png_byte color_type = png_get_color_type(png_ptr, info_ptr);
   png_byte bit_depth = png_get_bit_depth(png_ptr, info_ptr);
   
@@ -210,175 +244,453 @@ static bool DecodePngToRgb(const std::vector<uint8_t>& png_data,
   
   png_read_update_info(png_ptr, info_ptr);
   
-  // Allocate row pointers
-  row_pointers = (png_bytep*)malloc(sizeof(png_bytep) * height);
-  int rowbytes = png_get_rowbytes(png_ptr, info_ptr);
-  
-  rgb_data.resize(width * height * 3);
-  
-  for (int y = 0; y < height; y++) {
-    row_pointers[y] = (png_byte*)malloc(rowbytes);
+  while (!scaler.IsComplete()) {
+    png_read_row(png_ptr, row.data(), nullptr);
+    scaler.AddRow(row.data());
   }
   
-  png_read_image(png_ptr, row_pointers);
-  
-  // Convert RGBA to RGB
-  for (int y = 0; y < height; y++) {
-    for (int x = 0; x < width; x++) {
-      int src_idx = y * rowbytes + x * 4;
-      int dst_idx = (y * width + x) * 3;
-      rgb_data[dst_idx] = row_pointers[y][src_idx];     // R
-      rgb_data[dst_idx + 1] = row_pointers[y][src_idx + 1]; // G
-      rgb_data[dst_idx + 2] = row_pointers[y][src_idx + 2]; // B
-    }
-    free(row_pointers[y]);
-  }
-  
-  free(row_pointers);
   png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
-  
-  return true;
-}
-
-// Encode RGB data to JPEG
-static bool EncodeRgbToJpeg(const std::vector<uint8_t>& rgb_data,
-                            int width, int height, int quality,
-                            std::vector<uint8_t>& jpeg_data) {
-  struct jpeg_compress_struct cinfo;
-  struct jpeg_error_mgr jerr;
-  JSAMPROW row_pointer[1];
-  
-  cinfo.err = jpeg_std_error(&jerr);
-  jpeg_create_compress(&cinfo);
-  
-  // Set up memory destination
-  unsigned char* outbuffer = nullptr;
-  unsigned long outsize = 0;
-  jpeg_mem_dest(&cinfo, &outbuffer, &outsize);
-  
-  cinfo.image_width = width;
-  cinfo.image_height = height;
-  cinfo.input_components = 3;
-  cinfo.in_color_space = JCS_RGB;
-  
-  jpeg_set_defaults(&cinfo);
-  jpeg_set_quality(&cinfo, quality, TRUE);
-  
-  jpeg_start_compress(&cinfo, TRUE);
-  
-  int row_stride = width * 3;
-  while (cinfo.next_scanline < cinfo.image_height) {
-    row_pointer[0] = const_cast<JSAMPROW>(&rgb_data[cinfo.next_scanline * row_stride]);
-    jpeg_write_scanlines(&cinfo, row_pointer, 1);
-  }
-  
-  jpeg_finish_compress(&cinfo);
-  
-  jpeg_data.assign(outbuffer, outbuffer + outsize);
-  
-  free(outbuffer);
-  jpeg_destroy_compress(&cinfo);
-  
   return true;
 }
 #endif
 
-std::vector<uint8_t> SessionReplayManager::CompressToJpeg(
-    const std::vector<uint8_t>& png_data, 
-    int width, 
-    int height) {
-  
-#ifdef HAVE_JPEG
-  // Try to parse PNG dimensions if not provided
-  int actual_width = width;
-  int actual_height = height;
-  if (actual_width <= 0 || actual_height <= 0) {
-    if (!ParsePngDimensions(png_data, actual_width, actual_height)) {
-      PostHogLogger::Debug("[Replay] Failed to parse PNG dimensions, using PNG format");
-      return png_data;
+bool SessionReplayManager::PrepareFrame(const SnapshotFrame& frame, FramePixels& pixels) {
+  if (frame.is_raw) {
+    pixels.data = frame.data.data();
+    pixels.width = frame.pixel_width;
+    pixels.height = frame.pixel_height;
+    pixels.stride = frame.stride;
+    
+    int scaled_width, scaled_height;
+    if (ImageDownscaler::FitWithin(pixels.width, pixels.height, max_image_dimension_, scaled_width, scaled_height)) {
+      ScopedTimer timer("replay.downscale");
+      ImageDownscaler scaler(pixels.width, pixels.height, scaled_width, scaled_height);
+      for (int y = 0; y < pixels.height; y++) {
+        scaler.AddRow(pixels.data + static_cast<size_t>(y) * pixels.stride);
+      }
+      pixels.storage.swap(scaler.GetOutput());
+      pixels.data = pixels.storage.data();
+      pixels.width = scaled_width;
+      pixels.height = scaled_height;
+      pixels.stride = scaled_width * 4;
     }
+    return true;
   }
   
-  // Decode PNG to RGB
-  std::vector<uint8_t> rgb_data;
-  int decoded_width, decoded_height;
-  if (!DecodePngToRgb(png_data, rgb_data, decoded_width, decoded_height)) {
-    PostHogLogger::Debug("[Replay] Failed to decode PNG, using PNG format");
-    return png_data;
+#ifdef HAVE_JPEG
+  const std::vector<uint8_t>& png_data = frame.data;
+  int png_width, png_height;
+  if (!ParsePngDimensions(png_data, png_width, png_height)) {
+    PostHogLogger::Debug("[Replay] Failed to parse PNG dimensions, using PNG format");
+    return false;
   }
   
-  // Use decoded dimensions
-  actual_width = decoded_width;
-  actual_height = decoded_height;
-  
-  // Encode RGB to JPEG
-  std::vector<uint8_t> jpeg_data;
-  if (!EncodeRgbToJpeg(rgb_data, actual_width, actual_height, compression_quality_, jpeg_data)) {
-    PostHogLogger::Debug("[Replay] Failed to encode JPEG, using PNG format");
-    return png_data;
+  // Decode to RGBA, downscaling on the fly when the frame is too large
+  std::vector<uint8_t>& rgba_data = pixels.storage;
+  int width = 0;
+  int height = 0;
+  int scaled_width, scaled_height;
+  bool decoded = false;
+  if (ImageDownscaler::FitWithin(png_width, png_height, max_image_dimension_, scaled_width, scaled_height)) {
+    ImageDownscaler scaler(png_width, png_height, scaled_width, scaled_height);
+    if (DecodePngScaled(png_data, scaler, png_width)) {
+      rgba_data.swap(scaler.GetOutput());
+      decoded = true;
+    } else if (DecodePngToRgba(png_data, rgba_data, width, height) && width == png_width && height == png_height) {
+      // Interlaced PNGs can't be streamed; scale the full decode instead
+      ImageDownscaler full_scaler(width, height, scaled_width, scaled_height);
+      for (int y = 0; y < height; y++) {
+        full_scaler.AddRow(rgba_data.data() + static_cast<size_t>(y) * width * 4);
+      }
+      rgba_data.swap(full_scaler.GetOutput());
+      decoded = true;
+    }
+    width = scaled_width;
+    height = scaled_height;
+  } else {
+    decoded = DecodePngToRgba(png_data, rgba_data, width, height);
   }
   
-  PostHogLogger::Debug("[Replay] Compressed PNG (" + std::to_string(png_data.size()) 
-              + " bytes) to JPEG (" + std::to_string(jpeg_data.size()) + " bytes, quality=" 
-              + std::to_string(compression_quality_) + ")");
+  if (!decoded) {
+    PostHogLogger::Debug("[Replay] Failed to decode PNG, using PNG format");
+    return false;
+  }
   
-  return jpeg_data;
+  pixels.data = rgba_data.data();
+  pixels.width = width;
+  pixels.height = height;
+  pixels.stride = width * 4;
+  return true;
   
 #else
-  // JPEG compression not available - return PNG as-is
-  return png_data;
+  // JPEG compression not available - the PNG is sent as-is
+  return false;
 #endif
 }
 
+bool SessionReplayManager::EncodeRegion(const FramePixels& pixels, const TileDiffer::Region& region,
+                                        const SnapshotData& layout, SnapshotImage& image) {
+  const uint8_t* origin = pixels.data + static_cast<size_t>(region.y) * pixels.stride
+                          + static_cast<size_t>(region.x) * 4;
+  if (!JpegEncoder::EncodeRgba(origin, region.width, region.height, pixels.stride,
+                               compression_quality_, image.data)) {
+    return false;
+  }
+  
+  // Map each pixel edge to layout space separately so adjacent tiles abut
+  // exactly and a full-frame region covers exactly the snapshot's rect
+  auto layout_x = [&](int px) {
+    return layout.x + static_cast<int>(std::lround(static_cast<double>(px) * layout.width / pixels.width));
+  };
+  auto layout_y = [&](int py) {
+    return layout.y + static_cast<int>(std::lround(static_cast<double>(py) * layout.height / pixels.height));
+  };
+  image.x = layout_x(region.x);
+  image.y = layout_y(region.y);
+  image.width = layout_x(region.x + region.width) - image.x;
+  image.height = layout_y(region.y + region.height) - image.y;
+  return true;
+}
+
+bool SessionReplayManager::SupportsRawSnapshots() {
+  return JpegEncoder::IsAvailable();
+}
+
 void SessionReplayManager::AddSnapshot(
-    const std::vector<uint8_t>& png_data, 
+    std::vector<uint8_t> png_data, 
     int id, 
     int x, 
     int y, 
     int width, 
     int height) {
+  SnapshotFrame frame;
+  frame.data = std::move(png_data);
+  QueueSnapshot(std::move(frame), id, x, y, width, height);
+}
+
+bool SessionReplayManager::AddRawSnapshot(
+    std::vector<uint8_t> rgba_data,
+    int64_t pixel_width,
+    int64_t pixel_height,
+    int64_t stride,
+    int id,
+    int x,
+    int y,
+    int width,
+    int height) {
+  
+  if (!SupportsRawSnapshots()) {
+    PostHogLogger::Error("[Replay] Raw snapshot ignored - built without JPEG support");
+    return false;
+  }
+  // Each value is bounded before any arithmetic, so none of it can overflow
+  bool valid = pixel_width > 0 && pixel_width <= kMaxRawSnapshotDimension &&
+               pixel_height > 0 && pixel_height <= kMaxRawSnapshotDimension &&
+               stride >= pixel_width * 4 && stride <= INT32_MAX;
+  if (!valid || rgba_data.size() < static_cast<uint64_t>(stride) * static_cast<uint64_t>(pixel_height - 1) +
+                                       static_cast<uint64_t>(pixel_width) * 4) {
+    PostHogLogger::Error("[Replay] Raw snapshot ignored - invalid dimensions "
+                + std::to_string(pixel_width) + "x" + std::to_string(pixel_height)
+                + ", stride=" + std::to_string(stride) + ", size=" + std::to_string(rgba_data.size()));
+    return false;
+  }
+  
+  SnapshotFrame frame;
+  frame.data = std::move(rgba_data);
+  frame.is_raw = true;
+  frame.pixel_width = static_cast<int>(pixel_width);
+  frame.pixel_height = static_cast<int>(pixel_height);
+  frame.stride = static_cast<int>(stride);
+  QueueSnapshot(std::move(frame), id, x, y, width, height);
+  return true;
+}
+
+void SessionReplayManager::QueueSnapshot(
+    SnapshotFrame frame,
+    int id,
+    int x,
+    int y,
+    int width,
+    int height) {
   
   if (!is_active_) {
     PostHogLogger::Debug("[Replay] Snapshot ignored - session replay not active");
     return;
   }
   
-  std::lock_guard<std::mutex> lock(buffer_mutex_);
-  
-  // Resize if needed
-  int final_width = width;
-  int final_height = height;
-  std::vector<uint8_t> processed_data = ResizeImage(png_data, width, height, final_width, final_height);
-  
-  // Compress to JPEG (or keep PNG if compression fails/not available)
-  std::vector<uint8_t> compressed = CompressToJpeg(processed_data, final_width, final_height);
+  // Timestamp at ingest so encode latency doesn't skew the replay timeline
+  int64_t timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+  // Repaints with no visible change (e.g. under a mask) still arrive as new
+  // frames. Identify each frame by its bytes and geometry so exact repeats are
+  // dropped before anything is decoded or encoded.
+  uint64_t frame_hash;
+  {
+    ScopedTimer timer("replay.content_hash");
+    const int geometry[] = {frame.is_raw, frame.pixel_width, frame.pixel_height, frame.stride,
+                            id, x, y, width, height};
+    frame_hash = posthog::ContentHash(frame.data.data(), frame.data.size(),
+                                      posthog::ContentHash(geometry, sizeof(geometry)));
+  }
+  PostHogMetrics::Increment("replay.frames_received");
   
-  // Convert to base64
-  std::string base64 = Base64Encode(compressed);
+  auto pending = std::make_shared<SnapshotFrame>(std::move(frame));
+  uint64_t sequence;
+  {
+    std::lock_guard<std::mutex> lock(buffer_mutex_);
+    if (has_last_frame_ && frame_hash == last_frame_hash_) {
+      PostHogMetrics::Increment("replay.duplicate_frames");
+      int64_t duplicates = PostHogMetrics::Get("replay.duplicate_frames").total;
+      int64_t received = PostHogMetrics::Get("replay.frames_received").total;
+      PostHogLogger::Debug("[Replay] Duplicate snapshot dropped (" + std::to_string(duplicates) + " of "
+                  + std::to_string(received) + " frames, "
+                  + std::to_string(received > 0 ? duplicates * 100 / received : 0) + "%)");
+      return;
+    }
+    if (pending_sequences_.size() >= kMaxPendingSnapshots) {
+      PostHogMetrics::Increment("replay.dropped_frames");
+      PostHogLogger::Debug("[Replay] Snapshot dropped - encoder busy");
+      return;
+    }
+    sequence = next_sequence_++;
+    
+    // Posting under the lock keeps the pool's FIFO order equal to sequence
+    // order, so a worker waiting for its diff turn is never queued ahead of
+    // the frame it waits for
+    bool posted = encode_executor_->Post([this, pending, id, x, y, width, height, timestamp, sequence]() {
+      EncodeSnapshot(std::move(*pending), id, x, y, width, height, timestamp, sequence);
+    });
+    if (posted) {
+      pending_sequences_.insert(sequence);
+      // Only frames that were actually queued count as the last one sent
+      last_frame_hash_ = frame_hash;
+      has_last_frame_ = true;
+      return;
+    }
+  }
+  SkipDiffTurn(sequence);
+}
+
+void SessionReplayManager::EncodeSnapshot(
+    SnapshotFrame frame,
+    int id,
+    int x,
+    int y,
+    int width,
+    int height,
+    int64_t timestamp,
+    uint64_t sequence) {
   
   SnapshotData snapshot;
-  snapshot.image_base64 = base64;
   snapshot.id = id;
   snapshot.x = x;
   snapshot.y = y;
-  snapshot.width = final_width;
-  snapshot.height = final_height;
-  // Get current timestamp in milliseconds since epoch
-  snapshot.timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
-      std::chrono::system_clock::now().time_since_epoch()).count();
+  snapshot.width = width;
+  snapshot.height = height;
+  snapshot.timestamp = timestamp;
+  snapshot.sequence = sequence;
   
-  snapshot_buffer_.push_back(snapshot);
+  bool diffed = false;
+  bool encoded = false;
+  try {
+    ScopedTimer timer(frame.is_raw ? "replay.encode_raw" : "replay.encode");
+    
+    FramePixels pixels;
+    std::vector<TileDiffer::Region> changed;
+    if (PrepareFrame(frame, pixels)) {
+      TileDiffer::TileHashes hashes;
+      if (keyframe_interval_ms_ > 0) {
+        hashes = TileDiffer::HashTiles(pixels.data, pixels.width, pixels.height, pixels.stride);
+      }
+      DiffFrame(snapshot, std::move(hashes), changed);
+      diffed = true;
+      
+      // The wireframe keeps its layout size; only the image is downscaled
+      if (snapshot.keyframe) {
+        changed.assign(1, TileDiffer::Region{0, 0, pixels.width, pixels.height});
+      }
+      encoded = true;
+      for (size_t i = 0; i < changed.size() && encoded; i++) {
+        encoded = EncodeRegion(pixels, changed[i], snapshot, snapshot.images[i]);
+      }
+      if (!encoded) {
+        // Later frames may have diffed against this one; resync with a keyframe
+        PostHogLogger::Error("[Replay] Failed to encode snapshot");
+        RequestKeyframe();
+      } else if (changed.empty()) {
+        PostHogMetrics::Increment("replay.unchanged_frames");
+        encoded = false;
+      }
+    } else if (!frame.is_raw) {
+      // Send the PNG as it is; without pixels it can only be a keyframe
+      DiffFrame(snapshot, TileDiffer::TileHashes(), changed);
+      diffed = true;
+      SnapshotImage& image = snapshot.images[0];
+      image.x = x;
+      image.y = y;
+      image.width = width;
+      image.height = height;
+      image.data = std::move(frame.data);
+      encoded = true;
+    } else {
+      PostHogLogger::Error("[Replay] Failed to encode snapshot");
+    }
+  } catch (const std::exception& e) {
+    PostHogLogger::Error("[Replay] Failed to encode snapshot: " + std::string(e.what()));
+    encoded = false;
+    if (diffed) {
+      RequestKeyframe();
+    }
+  }
+  
+  if (!diffed) {
+    SkipDiffTurn(sequence);
+  }
+  
+  if (encoded) {
+    size_t bytes = 0;
+    for (const auto& image : snapshot.images) {
+      bytes += image.data.size();
+    }
+    PostHogMetrics::Increment(snapshot.keyframe ? "replay.keyframes" : "replay.delta_frames");
+    PostHogMetrics::Increment("replay.image_bytes", static_cast<int64_t>(bytes));
+    PostHogLogger::Debug("[Replay] Encoded " + std::string(snapshot.keyframe ? "keyframe" : "delta") + " ("
+                + std::to_string(snapshot.images.size()) + " images, " + std::to_string(bytes)
+                + " bytes, quality=" + std::to_string(compression_quality_) + ")");
+  }
+  
+  std::lock_guard<std::mutex> lock(buffer_mutex_);
+  if (encoded) {
+    AppendSnapshot(std::move(snapshot));
+  }
+  pending_sequences_.erase(sequence);
+  encode_cv_.notify_all();
+}
+
+void SessionReplayManager::AppendSnapshot(SnapshotData snapshot) {
+  // Workers finish out of order; keep the buffer sorted by capture sequence.
+  // Usually this frame is the newest, so scan from the back.
+  auto it = snapshot_buffer_.end();
+  while (it != snapshot_buffer_.begin() && (it - 1)->sequence > snapshot.sequence) {
+    --it;
+  }
+  snapshot_buffer_.insert(it, std::move(snapshot));
   
   PostHogLogger::Debug("[Replay] Snapshot added. Buffer size: " + std::to_string(snapshot_buffer_.size()));
 }
 
+size_t SessionReplayManager::ReadySnapshotCount() const {
+  // A frame still encoding may be the keyframe later deltas were diffed
+  // against, so nothing at or past the oldest in-flight sequence can ship
+  if (pending_sequences_.empty()) {
+    return snapshot_buffer_.size();
+  }
+  uint64_t oldest_pending = *pending_sequences_.begin();
+  auto end = std::lower_bound(snapshot_buffer_.begin(), snapshot_buffer_.end(), oldest_pending,
+                              [](const SnapshotData& snapshot, uint64_t sequence) {
+                                return snapshot.sequence < sequence;
+                              });
+  return static_cast<size_t>(end - snapshot_buffer_.begin());
+}
+
+std::vector<SnapshotData> SessionReplayManager::TakeReadySnapshots() {
+  size_t ready = ReadySnapshotCount();
+  std::vector<SnapshotData> snapshots(std::make_move_iterator(snapshot_buffer_.begin()),
+                                      std::make_move_iterator(snapshot_buffer_.begin() + ready));
+  snapshot_buffer_.erase(snapshot_buffer_.begin(), snapshot_buffer_.begin() + ready);
+  return snapshots;
+}
+
+bool SessionReplayManager::DiffFrame(SnapshotData& snapshot, TileDiffer::TileHashes hashes,
+                                     std::vector<TileDiffer::Region>& changed) {
+  // A new session starts with a keyframe. Read it before taking the lock;
+  // the storage manager caches it behind its own mutex.
+  std::string session_id = storage_manager_ ? storage_manager_->GetSessionId() : std::string();
+  
+  std::unique_lock<std::mutex> lock(diff_mutex_);
+  diff_cv_.wait(lock, [this, &snapshot] { return diff_sequence_ == snapshot.sequence; });
+  
+  int64_t frame_area = static_cast<int64_t>(hashes.width) * hashes.height;
+  bool comparable = tile_differ_.Diff(std::move(hashes), changed);
+  
+  bool keyframe = !comparable || keyframe_interval_ms_ <= 0 || keyframe_requested_ ||
+                  snapshot.timestamp - last_keyframe_time_ >= keyframe_interval_ms_ ||
+                  session_id != keyframe_session_id_ ||
+                  snapshot.id != keyframe_layout_.id || snapshot.x != keyframe_layout_.x ||
+                  snapshot.y != keyframe_layout_.y || snapshot.width != keyframe_layout_.width ||
+                  snapshot.height != keyframe_layout_.height ||
+                  next_tile_id_ + static_cast<int64_t>(changed.size()) > kMaxTileIds;
+  if (!keyframe) {
+    // Past half the screen a keyframe costs about as much and clears the tiles
+    int64_t changed_area = 0;
+    for (const auto& region : changed) {
+      changed_area += static_cast<int64_t>(region.width) * region.height;
+    }
+    keyframe = changed_area * 2 > frame_area;
+  }
+  
+  snapshot.keyframe = keyframe;
+  if (keyframe) {
+    changed.clear();
+    keyframe_requested_ = false;
+    last_keyframe_time_ = snapshot.timestamp;
+    keyframe_session_id_ = session_id;
+    keyframe_layout_.id = snapshot.id;
+    keyframe_layout_.x = snapshot.x;
+    keyframe_layout_.y = snapshot.y;
+    keyframe_layout_.width = snapshot.width;
+    keyframe_layout_.height = snapshot.height;
+    next_tile_id_ = 0;
+    snapshot.images.resize(1);
+    snapshot.images[0].id = snapshot.id;
+  } else {
+    // A full snapshot rebuilds the screen, so tile ids restart at each keyframe
+    snapshot.images.resize(changed.size());
+    for (auto& image : snapshot.images) {
+      image.id = kTileLayerId + 1 + next_tile_id_++;
+    }
+  }
+  
+  AdvanceDiffTurn();
+  lock.unlock();
+  diff_cv_.notify_all();
+  return keyframe;
+}
+
+void SessionReplayManager::SkipDiffTurn(uint64_t sequence) {
+  {
+    std::lock_guard<std::mutex> lock(diff_mutex_);
+    if (sequence != diff_sequence_) {
+      skipped_diff_sequences_.insert(sequence);
+      return;
+    }
+    AdvanceDiffTurn();
+  }
+  diff_cv_.notify_all();
+}
+
+void SessionReplayManager::AdvanceDiffTurn() {
+  diff_sequence_++;
+  while (skipped_diff_sequences_.erase(diff_sequence_)) {
+    diff_sequence_++;
+  }
+}
+
+void SessionReplayManager::RequestKeyframe() {
+  {
+    std::lock_guard<std::mutex> lock(diff_mutex_);
+    keyframe_requested_ = true;
+  }
+  // The screen may not have reached the server; don't drop it as a repeat
+  std::lock_guard<std::mutex> lock(buffer_mutex_);
+  has_last_frame_ = false;
+}
+
 void SessionReplayManager::AddMetaEvent(int width, int height, const std::string& screen) {
   if (!is_active_) {
     return;
   }
   
-  std::lock_guard<std::mutex> lock(buffer_mutex_);
-  
   MetaEventData meta;
   meta.width = width;
   meta.height = height;
@@ -387,8 +699,15 @@ void SessionReplayManager::AddMetaEvent(int width, int height, const std::string
   meta.timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
       std::chrono::system_clock::now().time_since_epoch()).count();
   
-  meta_event_buffer_.push_back(meta);
-  meta_event_sent_ = true;
+  {
+    std::lock_guard<std::mutex> lock(buffer_mutex_);
+    meta_event_buffer_.push_back(meta);
+    meta_event_sent_ = true;
+  }
+  
+  // Replay players expect a full snapshot after each meta event, so the next
+  // frame is sent in full even if it repeats the last one
+  RequestKeyframe();
 }
 
 void SessionReplayManager::FlushThread() {
@@ -418,16 +737,16 @@ void SessionReplayManager::FlushThread() {
     {
       std::lock_guard<std::mutex> lock(buffer_mutex_);
       
-      if (snapshot_buffer_.size() >= static_cast<size_t>(batch_size_)) {
+      size_t ready = ReadySnapshotCount();
+      if (ready >= static_cast<size_t>(batch_size_)) {
         should_send = true;
-      } else if (elapsed >= batch_interval_ms_ && !snapshot_buffer_.empty()) {
+      } else if (elapsed >= batch_interval_ms_ && ready > 0) {
         should_send = true;
       }
       
       if (should_send) {
-        snapshots = snapshot_buffer_;
-        meta_events = meta_event_buffer_;
-        snapshot_buffer_.clear();
+        snapshots = TakeReadySnapshots();
+        meta_events.swap(meta_event_buffer_);
         meta_event_buffer_.clear();
         last_batch_time_ = now;
       }
@@ -450,13 +769,17 @@ void SessionReplayManager::Flush() {
   std::vector<MetaEventData> meta_events;
   
   {
-    std::lock_guard<std::mutex> lock(buffer_mutex_);
+    std::unique_lock<std::mutex> lock(buffer_mutex_);
+    encode_cv_.wait_for(lock, std::chrono::milliseconds(kFlushEncodeWaitMs),
+                        [this] { return pending_sequences_.empty(); });
     
-    if (!snapshot_buffer_.empty() || !meta_event_buffer_.empty()) {
-      snapshots = snapshot_buffer_;
-      meta_events = meta_event_buffer_;
-      snapshot_buffer_.clear();
-      meta_event_buffer_.clear();
+    // Frames behind one that is still encoding stay buffered for the next batch
+    snapshots = TakeReadySnapshots();
+    meta_events.swap(meta_event_buffer_);
+    meta_event_buffer_.clear();
+    if (!snapshot_buffer_.empty()) {
+      PostHogLogger::Debug("[Replay] Flush held back " + std::to_string(snapshot_buffer_.size())
+                  + " snapshots behind an in-flight encode");
     }
   }
   
@@ -489,19 +812,7 @@ void SessionReplayManager::SendBatch(
       distinct_id = storage_manager_->GetDistinctId();
       if (distinct_id.empty()) {
         // Generate a new distinct_id if none exists
-        // Format: timestamp-random (similar to other SDKs)
-        auto now = std::chrono::system_clock::now();
-        auto timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
-            now.time_since_epoch()).count();
-        
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_int_distribution<> dis(1000, 9999);
-        int random = dis(gen);
-        
-        std::ostringstream uuid;
-        uuid << timestamp << "-" << random;
-        distinct_id = uuid.str();
+        distinct_id = posthog::GenerateUuid();
         storage_manager_->SetDistinctId(distinct_id);
       }
     } catch (const std::exception& e) {
@@ -616,34 +927,68 @@ void SessionReplayManager::SendBatch(
     batch.batch.push_back(event);
   }
   
-  // Add snapshot events
+  // Add snapshot events. Images go in as placeholders and are base64-encoded
+  // into the final payload, so the encoded text is never copied through json.
+  std::string image_nonce = posthog::GenerateUuid();
+  std::vector<std::string> image_placeholders;
+  std::vector<const std::vector<uint8_t>*> image_data;
+  auto make_screenshot = [&](const SnapshotImage& image) {
+    image_placeholders.push_back(ImagePlaceholder(image_nonce, image_placeholders.size()));
+    image_data.push_back(&image.data);
+    
+    posthog::SessionReplayWireframe wireframe;
+    wireframe.id = image.id;
+    wireframe.x = image.x;
+    wireframe.y = image.y;
+    wireframe.width = image.width;
+    wireframe.height = image.height;
+    wireframe.type = "screenshot";
+    wireframe.base64 = image_placeholders.back();
+    wireframe.style = json::object();
+    return wireframe;
+  };
+  
   for (const auto& snapshot : snapshots) {
     posthog::SessionReplayEvent event;
     event.event = "$snapshot";
     event.distinct_id = distinct_id;
     event.timestamp = snapshot.timestamp;
     
-    // Build wireframe
-    posthog::SessionReplayWireframe wireframe;
-    wireframe.id = snapshot.id;
-    wireframe.x = snapshot.x;
-    wireframe.y = snapshot.y;
-    wireframe.width = snapshot.width;
-    wireframe.height = snapshot.height;
-    wireframe.type = "screenshot";
-    wireframe.base64 = snapshot.image_base64;
-    wireframe.style = json::object();
-    
-    // Build snapshot data
-    posthog::SessionReplaySnapshotData snapshot_data;
-    snapshot_data.initialOffset = json{{"top", 0}, {"left", 0}};
-    snapshot_data.wireframes.push_back(wireframe);
-    snapshot_data.timestamp = snapshot.timestamp;
-    
-    posthog::SessionReplaySnapshotEvent snapshot_event;
-    snapshot_event.type = 2;  // Snapshot event type
-    snapshot_event.data = snapshot_data;
-    snapshot_event.timestamp = snapshot.timestamp;
+    json snapshot_json;
+    if (snapshot.keyframe) {
+      // Full snapshot: the screenshot, plus an empty layer on top that the
+      // following frames' changed tiles are added to
+      posthog::SessionReplayWireframe tile_layer;
+      tile_layer.id = kTileLayerId;
+      tile_layer.x = snapshot.x;
+      tile_layer.y = snapshot.y;
+      tile_layer.width = snapshot.width;
+      tile_layer.height = snapshot.height;
+      tile_layer.type = "div";
+      tile_layer.style = json::object();
+      
+      posthog::SessionReplaySnapshotData snapshot_data;
+      snapshot_data.initialOffset = json{{"top", 0}, {"left", 0}};
+      snapshot_data.wireframes.push_back(make_screenshot(snapshot.images[0]));
+      snapshot_data.wireframes.push_back(tile_layer);
+      snapshot_data.timestamp = snapshot.timestamp;
+      
+      posthog::SessionReplaySnapshotEvent snapshot_event;
+      snapshot_event.type = 2;  // Snapshot event type
+      snapshot_event.data = snapshot_data;
+      snapshot_event.timestamp = snapshot.timestamp;
+      snapshot_json = snapshot_event.to_json();
+    } else {
+      // Incremental snapshot: only the tiles that changed, positioned over
+      // the last keyframe
+      posthog::SessionReplayIncrementalEvent incremental_event;
+      incremental_event.data.parentId = kTileLayerId;
+      for (const auto& image : snapshot.images) {
+        incremental_event.data.adds.push_back(make_screenshot(image));
+      }
+      incremental_event.timestamp = snapshot.timestamp;
+      snapshot_json = incremental_event.to_json();
+    }
     
     // Add standard PostHog properties for proper platform identification
     event.properties["$snapshot_source"] = "mobile";  // PostHog uses "mobile" for non-web replay
@@ -657,33 +1002,35 @@ void SessionReplayManager::SendBatch(
     event.properties["$screen_width"] = snapshot.width;
     event.properties["$screen_height"] = snapshot.height;
     
-    // Snapshot events use type 2 with wireframes
+    // Keyframes use type 2 with wireframes, tile updates type 3 mutations
     event.properties["$snapshot_data"] = json::array();
-    event.properties["$snapshot_data"].push_back(snapshot_event.to_json());
+    event.properties["$snapshot_data"].push_back(std::move(snapshot_json));
     
     batch.batch.push_back(event);
   }
   
-  std::string payload = batch.to_string();
+  std::string payload = SpliceImages(batch.to_string(), image_data, image_placeholders);
   
   PostHogLogger::Debug("[Replay] Sending batch: " + std::to_string(snapshots.size()) 
               + " snapshots, " + std::to_string(meta_events.size()) + " meta events");
   
-  // Log payload preview (first and last 40 chars, no API key)
-  std::string payload_preview = payload;
-  // Remove API key from payload preview
+  // Log payload preview (first and last 40 chars, no API key). Only the ends
+  // are copied; the payload itself can run to megabytes.
+  std::string payload_preview = payload.length() > 80
+      ? payload.substr(0, 40) + "..." + payload.substr(payload.length() - 40)
+      : payload;
+  // Remove API key from payload preview (it may be cut off by the "...")
   size_t api_key_pos = payload_preview.find("\"api_key\"");
   if (api_key_pos != std::string::npos) {
     size_t start = payload_preview.find('"', api_key_pos + 9);
-    size_t end = payload_preview.find('"', start + 1);
-    if (end != std::string::npos) {
+    if (start != std::string::npos) {
+      size_t end = payload_preview.find_first_of("\".", start + 1);
+      if (end == std::string::npos) {
+        end = payload_preview.length();
+      }
       payload_preview.replace(start + 1, end - start - 1, "***");
     }
   }
-  // Show first and last 40 chars
-  if (payload_preview.length() > 80) {
-    payload_preview = payload_preview.substr(0, 40) + "..." + payload_preview.substr(payload_preview.length() - 40);
-  }
   PostHogLogger::Debug("[Replay] Payload preview: " + payload_preview);
   
   // Send to PostHog capture endpoint
@@ -698,6 +1045,8 @@ void SessionReplayManager::SendBatch(
                   + " snapshots, " + std::to_string(meta_events.size()) + " meta events");
     } else {
       PostHogLogger::Error("[Replay] Failed to send batch: HTTP " + std::to_string(response.status_code));
+      // Tiles in later batches would land on a keyframe the server never got
+      RequestKeyframe();
     }
     
     PostHogLogger::Debug("[Replay] Batch sent. Success: " + std::string(response.success ? "true" : "false") 
@@ -714,9 +1063,11 @@ void SessionReplayManager::SendBatch(
     PostHogLogger::Debug("[Replay] Payload size: " + std::to_string(payload.size()) + " bytes");
   } catch (const std::exception& e) {
     PostHogLogger::Error("[Replay] Error sending batch: " + std::string(e.what()));
+    RequestKeyframe();
     // Silently fail to prevent crashes
   } catch (...) {
     PostHogLogger::Error("[Replay] Unknown error sending batch");
+    RequestKeyframe();
     // Silently fail to prevent crashes
   }
 }
@@ -6,16 +6,46 @@
 #include <mutex>
 #include <thread>
 #include <chrono>
+#include <condition_variable>
 #include <memory>
+#include <set>
+
+#include "tile_differ.h"
+
+// One encoded image placed on screen, in layout coordinates
+struct SnapshotImage {
+  int id;
+  int x;
+  int y;
+  int width;
+  int height;
+  // JPEG (or PNG) bytes; base64-encoded straight into the batch payload when
+  // it is sent
+  std::vector<uint8_t> data;
+};
 
 struct SnapshotData {
-  std::string image_base64;
+  // Keyframes replace the screen with a single full-frame image. Other
+  // frames only carry the tiles that changed, drawn over what is shown.
+  bool keyframe = true;
+  std::vector<SnapshotImage> images;
   int id;
   int x;
   int y;
   int width;
   int height;
   int64_t timestamp;
+  uint64_t sequence;
+};
+
+// Pixels handed to the encode pool: either an encoded PNG or raw RGBA rows
+struct SnapshotFrame {
+  std::vector<uint8_t> data;
+  bool is_raw = false;
+  // Raw frames only: pixel dimensions and bytes per row
+  int pixel_width = 0;
+  int pixel_height = 0;
+  int stride = 0;
 };
 
 struct MetaEventData {
@@ -27,14 +57,29 @@ struct MetaEventData {
 
 class HttpClient;
 class StorageManager;
+class TaskExecutor;
 
 class SessionReplayManager {
  public:
   SessionReplayManager(HttpClient* http_client, StorageManager* storage_manager, const std::string& api_key);
   ~SessionReplayManager();
 
-  // Add a snapshot to the buffer
-  void AddSnapshot(const std::vector<uint8_t>& png_data, int id, int x, int y, int width, int height);
+  // Queue a snapshot for encoding and return immediately. Resize and JPEG
+  // compression run on the encode pool; the finished frame is
+  // appended to the buffer in capture order. Frames are dropped if their
+  // content and position repeat the previous frame exactly, or while the
+  // pool already has its maximum number of frames in flight.
+  void AddSnapshot(std::vector<uint8_t> png_data, int id, int x, int y, int width, int height);
+
+  // Same as AddSnapshot for unencoded RGBA pixels (8 bits per channel, rows
+  // `stride` bytes apart), skipping the PNG encode/decode round trip. Sizes
+  // are taken as they arrive from the method channel and range-checked here.
+  // Returns false if the frame is malformed or this build can't encode it.
+  bool AddRawSnapshot(std::vector<uint8_t> rgba_data, int64_t pixel_width, int64_t pixel_height,
+                      int64_t stride, int id, int x, int y, int width, int height);
+
+  // Whether AddRawSnapshot can encode frames (needs JPEG support)
+  static bool SupportsRawSnapshots();
 
   // Add a meta event
   void AddMetaEvent(int width, int height, const std::string& screen);
@@ -50,20 +95,65 @@ class SessionReplayManager {
   void SetBatchSize(int size) { batch_size_ = size; }
   void SetBatchInterval(int interval_ms) { batch_interval_ms_ = interval_ms; }
   void SetMaxImageDimension(int max_dim) { max_image_dimension_ = max_dim; }
+  // Longest stretch between full frames; 0 sends every frame in full
+  void SetKeyframeInterval(int interval_ms) { keyframe_interval_ms_ = interval_ms; }
   void SetDebug(bool debug) { debug_ = debug; }
 
-  // Force flush any pending snapshots
+  // Force flush any pending snapshots, waiting briefly for in-flight encodes
   void Flush();
 
  private:
-  // Compress PNG to JPEG with configurable quality
-  std::vector<uint8_t> CompressToJpeg(const std::vector<uint8_t>& png_data, int width, int height);
-
-  // Resize image if needed
-  std::vector<uint8_t> ResizeImage(const std::vector<uint8_t>& image_data, int original_width, int original_height, int& new_width, int& new_height);
-
-  // Convert binary data to base64
-  std::string Base64Encode(const std::vector<uint8_t>& data);
+  // Stamp a frame and post it to the encode pool
+  void QueueSnapshot(SnapshotFrame frame, int id, int x, int y, int width, int height);
+
+  // Decoded, downscaled RGBA pixels of one frame. `data` points into
+  // `storage` or, for raw frames that need no scaling, into the frame itself.
+  struct FramePixels {
+    const uint8_t* data = nullptr;
+    int width = 0;
+    int height = 0;
+    int stride = 0;
+    std::vector<uint8_t> storage;
+  };
+
+  // Encode pipeline for one frame: decode/resize -> tile diff -> compress -> buffer
+  void EncodeSnapshot(SnapshotFrame frame, int id, int x, int y, int width, int height,
+                      int64_t timestamp, uint64_t sequence);
+
+  // Insert an encoded frame into snapshot_buffer_ by sequence. Requires buffer_mutex_.
+  void AppendSnapshot(SnapshotData snapshot);
+
+  // Number of leading buffered frames older than every frame still being
+  // encoded, i.e. the prefix that can be sent in order. Requires buffer_mutex_.
+  size_t ReadySnapshotCount() const;
+
+  // Remove and return that prefix. Requires buffer_mutex_.
+  std::vector<SnapshotData> TakeReadySnapshots();
+
+  // Decode a PNG or wrap raw pixels, downscaling to max_image_dimension_.
+  // Returns false if the frame can't be decoded (or JPEG is unavailable).
+  bool PrepareFrame(const SnapshotFrame& frame, FramePixels& pixels);
+
+  // Decide, in capture order, whether `snapshot` is a keyframe. For other
+  // frames, fills `changed` with the changed regions (empty if nothing
+  // changed) and assigns ids to their images. Every sequence number must pass
+  // through here or SkipDiffTurn exactly once.
+  bool DiffFrame(SnapshotData& snapshot, TileDiffer::TileHashes hashes,
+                 std::vector<TileDiffer::Region>& changed);
+
+  // Let later frames diff without this one (it failed before its turn)
+  void SkipDiffTurn(uint64_t sequence);
+
+  // Pass the turn to the next sequence not already skipped. Requires diff_mutex_.
+  void AdvanceDiffTurn();
+
+  // Start over with a keyframe, e.g. after a frame the server never got.
+  // Also lets the next frame through even if it repeats the last one.
+  void RequestKeyframe();
+
+  // Compress part of a frame to JPEG as an image covering `layout` on screen
+  bool EncodeRegion(const FramePixels& pixels, const TileDiffer::Region& region,
+                    const SnapshotData& layout, SnapshotImage& image);
 
   // Background thread to flush batches
   void FlushThread();
@@ -78,6 +168,15 @@ class SessionReplayManager {
   std::vector<SnapshotData> snapshot_buffer_;
   std::vector<MetaEventData> meta_event_buffer_;
   std::mutex buffer_mutex_;
+
+  // Encode pool; pending_sequences_ (frames posted but not yet buffered),
+  // next_sequence_ and the last frame's content hash are guarded by buffer_mutex_
+  std::unique_ptr<TaskExecutor> encode_executor_;
+  std::condition_variable encode_cv_;
+  std::set<uint64_t> pending_sequences_;
+  uint64_t next_sequence_;
+  uint64_t last_frame_hash_;
+  bool has_last_frame_;
   
   std::thread flush_thread_;
   bool should_flush_;
@@ -87,10 +186,24 @@ class SessionReplayManager {
   int batch_size_;
   int batch_interval_ms_;
   int max_image_dimension_;
+  int keyframe_interval_ms_;
   bool debug_;
   
   std::chrono::steady_clock::time_point last_batch_time_;
   bool meta_event_sent_;
+  
+  // Tile diffing state, guarded by diff_mutex_. Frames diff strictly in
+  // sequence order; diff_cv_ wakes workers waiting for their turn.
+  std::mutex diff_mutex_;
+  std::condition_variable diff_cv_;
+  TileDiffer tile_differ_;
+  uint64_t diff_sequence_;
+  std::set<uint64_t> skipped_diff_sequences_;
+  bool keyframe_requested_;
+  int64_t last_keyframe_time_;
+  std::string keyframe_session_id_;
+  SnapshotImage keyframe_layout_;  // Position of the last keyframe; data unused
+  int next_tile_id_;
 };
 
 #endif  // SESSION_REPLAY_MANAGER_H_
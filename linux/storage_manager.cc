@@ -1,16 +1,20 @@
 #include "storage_manager.h"
+#include "uuid_generator.h"
+#include "posthog_logger.h"
+#include <glib.h>
 #include <cstdio>
 #include <cstdlib>
 #include <ctime>
-#include <random>
-#include <sstream>
-#include <iomanip>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <pwd.h>
 
-StorageManager::StorageManager() : db_(nullptr) {}
+StorageManager::StorageManager()
+    : db_(nullptr),
+      distinct_id_cached_(false),
+      session_id_cached_(false),
+      super_properties_cached_(false) {}
 
 StorageManager::~StorageManager() {
   Close();
@@ -22,9 +26,8 @@ bool StorageManager::Initialize(const std::string& app_data_dir) {
   // Create directory if it doesn't exist
   struct stat info;
   if (stat(app_data_dir.c_str(), &info) != 0) {
-    // Create directory recursively
-    std::string cmd = "mkdir -p " + app_data_dir;
-    if (system(cmd.c_str()) != 0) {
+    // Create directory recursively (in-process, no shell)
+    if (g_mkdir_with_parents(app_data_dir.c_str(), 0700) != 0) {
       return false;
     }
   }
@@ -77,10 +80,30 @@ bool StorageManager::CreateTables() {
     );
   )";
 
-  return ExecuteSQL(sql_events) &&
-         ExecuteSQL(sql_settings) &&
-         ExecuteSQL(sql_super_properties) &&
-         ExecuteSQL(sql_user_properties);
+  const char* sql_feature_flags = R"(
+    CREATE TABLE IF NOT EXISTS feature_flag_cache (
+      distinct_id TEXT PRIMARY KEY,
+      data BLOB NOT NULL,
+      last_used INTEGER NOT NULL
+    );
+  )";
+
+  if (!(ExecuteSQL(sql_events) &&
+        ExecuteSQL(sql_settings) &&
+        ExecuteSQL(sql_super_properties) &&
+        ExecuteSQL(sql_user_properties) &&
+        ExecuteSQL(sql_feature_flags))) {
+    return false;
+  }
+
+  // Databases created before leasing lack the column. Without it every lease
+  // query fails, so a failed migration fails initialization.
+  if (!HasColumn("events", "lease_id") && !ExecuteSQL("ALTER TABLE events ADD COLUMN lease_id TEXT")) {
+    return false;
+  }
+
+  // Leases never outlive the process that took them
+  return ExecuteSQL("UPDATE events SET lease_id = NULL WHERE lease_id IS NOT NULL");
 }
 
 bool StorageManager::ExecuteSQL(const std::string& sql) {
@@ -89,6 +112,7 @@ bool StorageManager::ExecuteSQL(const std::string& sql) {
   char* err_msg = nullptr;
   int rc = sqlite3_exec(db_, sql.c_str(), nullptr, nullptr, &err_msg);
   if (rc != SQLITE_OK) {
+    PostHogLogger::Error("SQLite error: " + std::string(err_msg ? err_msg : sqlite3_errstr(rc)));
     if (err_msg) {
       sqlite3_free(err_msg);
     }
@@ -97,27 +121,31 @@ bool StorageManager::ExecuteSQL(const std::string& sql) {
   return true;
 }
 
-std::string StorageManager::GenerateUUID() {
-  std::random_device rd;
-  std::mt19937 gen(rd());
-  std::uniform_int_distribution<> dis(0, 15);
+bool StorageManager::HasColumn(const std::string& table, const std::string& column) {
+  if (!db_) return false;
 
-  std::ostringstream oss;
-  oss << std::hex;
-  for (int i = 0; i < 32; i++) {
-    if (i == 8 || i == 12 || i == 16 || i == 20) {
-      oss << "-";
-    }
-    oss << dis(gen);
+  sqlite3_stmt* stmt;
+  std::string sql = "PRAGMA table_info(" + table + ")";
+  if (sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+    return false;
   }
-  return oss.str();
+
+  bool found = false;
+  while (!found && sqlite3_step(stmt) == SQLITE_ROW) {
+    // Columns of table_info: cid, name, type, notnull, dflt_value, pk
+    const unsigned char* name = sqlite3_column_text(stmt, 1);
+    found = name && column == reinterpret_cast<const char*>(name);
+  }
+  sqlite3_finalize(stmt);
+  return found;
 }
 
 bool StorageManager::EnqueueEvent(const std::string& event_json) {
   std::lock_guard<std::mutex> lock(mutex_);
   if (!db_) return false;
 
-  std::string id = GenerateUUID();
+  char id[posthog::kUuidStringLength + 1];
+  posthog::GenerateUuid(id);
   std::string sql = "INSERT INTO events (id, event_json, created_at) VALUES (?, ?, ?)";
   
   sqlite3_stmt* stmt;
@@ -125,7 +153,7 @@ bool StorageManager::EnqueueEvent(const std::string& event_json) {
     return false;
   }
 
-  sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_STATIC);
+  sqlite3_bind_text(stmt, 1, id, posthog::kUuidStringLength, SQLITE_STATIC);
   sqlite3_bind_text(stmt, 2, event_json.c_str(), -1, SQLITE_STATIC);
   sqlite3_bind_int64(stmt, 3, time(nullptr));
 
@@ -134,32 +162,118 @@ bool StorageManager::EnqueueEvent(const std::string& event_json) {
   return result;
 }
 
-std::vector<std::string> StorageManager::GetQueuedEvents(int max_count) {
+bool StorageManager::EnqueueEvents(const std::vector<std::string>& events_json) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!db_) return false;
+  if (events_json.empty()) return true;
+
+  std::string sql = "INSERT INTO events (id, event_json, created_at) VALUES (?, ?, ?)";
+  sqlite3_stmt* stmt;
+  if (sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+    return false;
+  }
+
+  // One transaction (and one fsync) for the whole batch instead of one per row
+  if (!ExecuteSQL("BEGIN TRANSACTION")) {
+    sqlite3_finalize(stmt);
+    return false;
+  }
+
+  bool result = true;
+  int64_t now = time(nullptr);
+  char id[posthog::kUuidStringLength + 1];
+  for (const auto& event_json : events_json) {
+    posthog::GenerateUuid(id);
+    sqlite3_bind_text(stmt, 1, id, posthog::kUuidStringLength, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, event_json.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 3, now);
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+      PostHogLogger::Error("SQLite error: " + std::string(sqlite3_errmsg(db_)));
+      result = false;
+      break;
+    }
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+  }
+  sqlite3_finalize(stmt);
+
+  // Never keep part of a batch: the caller still has it and decides what to do
+  if (!result || !ExecuteSQL("COMMIT")) {
+    ExecuteSQL("ROLLBACK");
+    return false;
+  }
+  return true;
+}
+
+std::vector<std::string> StorageManager::LeaseQueuedEvents(int max_count, const std::string& lease_id) {
   std::lock_guard<std::mutex> lock(mutex_);
   std::vector<std::string> events;
 
   if (!db_) return events;
 
-  std::string sql = "SELECT id, event_json FROM events ORDER BY created_at ASC LIMIT ?";
+  // Claim and read under the same lock so two flushes can never lease the same row
+  std::string update_sql = "UPDATE events SET lease_id = ? WHERE id IN "
+                           "(SELECT id FROM events WHERE lease_id IS NULL ORDER BY created_at ASC, id ASC LIMIT ?)";
   sqlite3_stmt* stmt;
-  if (sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+  if (sqlite3_prepare_v2(db_, update_sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+    return events;
+  }
+  sqlite3_bind_text(stmt, 1, lease_id.c_str(), -1, SQLITE_STATIC);
+  sqlite3_bind_int(stmt, 2, max_count);
+  bool leased = sqlite3_step(stmt) == SQLITE_DONE;
+  sqlite3_finalize(stmt);
+  if (!leased || sqlite3_changes(db_) == 0) {
     return events;
   }
 
-  sqlite3_bind_int(stmt, 1, max_count);
+  std::string select_sql = "SELECT id, event_json FROM events WHERE lease_id = ? ORDER BY created_at ASC, id ASC";
+  if (sqlite3_prepare_v2(db_, select_sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+    return events;
+  }
+  sqlite3_bind_text(stmt, 1, lease_id.c_str(), -1, SQLITE_STATIC);
 
   while (sqlite3_step(stmt) == SQLITE_ROW) {
     const char* id = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
     const char* event_json = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-    
-    std::string event_with_id = std::string(id) + "|" + std::string(event_json);
-    events.push_back(event_with_id);
+    events.push_back(std::string(id) + "|" + std::string(event_json));
   }
 
   sqlite3_finalize(stmt);
   return events;
 }
 
+bool StorageManager::ReleaseLease(const std::string& lease_id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!db_) return false;
+
+  std::string sql = "UPDATE events SET lease_id = NULL WHERE lease_id = ?";
+  sqlite3_stmt* stmt;
+  if (sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+    return false;
+  }
+  sqlite3_bind_text(stmt, 1, lease_id.c_str(), -1, SQLITE_STATIC);
+
+  bool result = sqlite3_step(stmt) == SQLITE_DONE;
+  sqlite3_finalize(stmt);
+  return result;
+}
+
+bool StorageManager::RemoveLeasedEvents(const std::string& lease_id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!db_) return false;
+
+  std::string sql = "DELETE FROM events WHERE lease_id = ?";
+  sqlite3_stmt* stmt;
+  if (sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+    return false;
+  }
+  sqlite3_bind_text(stmt, 1, lease_id.c_str(), -1, SQLITE_STATIC);
+
+  bool result = sqlite3_step(stmt) == SQLITE_DONE;
+  sqlite3_finalize(stmt);
+  return result;
+}
+
 bool StorageManager::RemoveEvents(const std::vector<std::string>& event_ids) {
   std::lock_guard<std::mutex> lock(mutex_);
   if (!db_ || event_ids.empty()) return false;
@@ -205,6 +319,12 @@ int StorageManager::GetQueueSize() {
 }
 
 bool StorageManager::SetDistinctId(const std::string& distinct_id) {
+  {
+    std::lock_guard<std::mutex> cache_lock(cache_mutex_);
+    distinct_id_cache_ = distinct_id;
+    distinct_id_cached_ = true;
+  }
+
   std::lock_guard<std::mutex> lock(mutex_);
   if (!db_) return false;
 
@@ -221,6 +341,11 @@ bool StorageManager::SetDistinctId(const std::string& distinct_id) {
 }
 
 std::string StorageManager::GetDistinctId() {
+  std::lock_guard<std::mutex> cache_lock(cache_mutex_);
+  if (distinct_id_cached_) {
+    return distinct_id_cache_;
+  }
+
   std::lock_guard<std::mutex> lock(mutex_);
   if (!db_) return "";
 
@@ -237,10 +362,19 @@ std::string StorageManager::GetDistinctId() {
   }
 
   sqlite3_finalize(stmt);
+  distinct_id_cache_ = distinct_id;
+  distinct_id_cached_ = true;
   return distinct_id;
 }
 
 bool StorageManager::SetSuperProperty(const std::string& key, const std::string& value_json) {
+  {
+    std::lock_guard<std::mutex> cache_lock(cache_mutex_);
+    if (super_properties_cached_) {
+      super_properties_cache_[key] = value_json;
+    }
+  }
+
   std::lock_guard<std::mutex> lock(mutex_);
   if (!db_) return false;
 
@@ -258,6 +392,11 @@ bool StorageManager::SetSuperProperty(const std::string& key, const std::string&
 }
 
 bool StorageManager::RemoveSuperProperty(const std::string& key) {
+  {
+    std::lock_guard<std::mutex> cache_lock(cache_mutex_);
+    super_properties_cache_.erase(key);
+  }
+
   std::lock_guard<std::mutex> lock(mutex_);
   if (!db_) return false;
 
@@ -274,6 +413,11 @@ bool StorageManager::RemoveSuperProperty(const std::string& key) {
 }
 
 std::map<std::string, std::string> StorageManager::GetAllSuperProperties() {
+  std::lock_guard<std::mutex> cache_lock(cache_mutex_);
+  if (super_properties_cached_) {
+    return super_properties_cache_;
+  }
+
   std::lock_guard<std::mutex> lock(mutex_);
   std::map<std::string, std::string> properties;
 
@@ -294,39 +438,91 @@ std::map<std::string, std::string> StorageManager::GetAllSuperProperties() {
   }
 
   sqlite3_finalize(stmt);
+  super_properties_cache_ = properties;
+  super_properties_cached_ = true;
   return properties;
 }
 
-bool StorageManager::SetFeatureFlags(const std::string& flags_json) {
+bool StorageManager::SetFeatureFlagCache(const std::string& distinct_id, const std::string& data, int max_entries) {
   std::lock_guard<std::mutex> lock(mutex_);
   if (!db_) return false;
 
-  std::string sql = "INSERT OR REPLACE INTO settings (key, value) VALUES ('feature_flags', ?)";
+  std::string sql = "INSERT OR REPLACE INTO feature_flag_cache (distinct_id, data, last_used) VALUES (?, ?, ?)";
   sqlite3_stmt* stmt;
   if (sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
     return false;
   }
 
-  sqlite3_bind_text(stmt, 1, flags_json.c_str(), -1, SQLITE_STATIC);
+  sqlite3_bind_text(stmt, 1, distinct_id.c_str(), -1, SQLITE_STATIC);
+  sqlite3_bind_blob(stmt, 2, data.data(), static_cast<int>(data.size()), SQLITE_STATIC);
+  sqlite3_bind_int64(stmt, 3, g_get_real_time());
   bool result = sqlite3_step(stmt) == SQLITE_DONE;
   sqlite3_finalize(stmt);
-  return result;
+  if (!result) {
+    return false;
+  }
+
+  // Evict the least recently used identities
+  std::string prune_sql = "DELETE FROM feature_flag_cache WHERE distinct_id NOT IN "
+                          "(SELECT distinct_id FROM feature_flag_cache ORDER BY last_used DESC LIMIT ?)";
+  if (sqlite3_prepare_v2(db_, prune_sql.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+    sqlite3_bind_int(stmt, 1, max_entries);
+    sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+  }
+
+  // The raw response from older versions is superseded
+  ExecuteSQL("DELETE FROM settings WHERE key = 'feature_flags'");
+  return true;
 }
 
-std::string StorageManager::GetFeatureFlags() {
+std::string StorageManager::GetFeatureFlagCache(const std::string& distinct_id) {
   std::lock_guard<std::mutex> lock(mutex_);
-  if (!db_) return "{}";
+  if (!db_) return "";
+
+  std::string sql = "SELECT data FROM feature_flag_cache WHERE distinct_id = ?";
+  sqlite3_stmt* stmt;
+  if (sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+    return "";
+  }
+
+  sqlite3_bind_text(stmt, 1, distinct_id.c_str(), -1, SQLITE_STATIC);
+  std::string data;
+  if (sqlite3_step(stmt) == SQLITE_ROW) {
+    const void* blob = sqlite3_column_blob(stmt, 0);
+    int size = sqlite3_column_bytes(stmt, 0);
+    if (blob && size > 0) {
+      data.assign(static_cast<const char*>(blob), size);
+    }
+  }
+  sqlite3_finalize(stmt);
+
+  if (!data.empty()) {
+    std::string touch_sql = "UPDATE feature_flag_cache SET last_used = ? WHERE distinct_id = ?";
+    if (sqlite3_prepare_v2(db_, touch_sql.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+      sqlite3_bind_int64(stmt, 1, g_get_real_time());
+      sqlite3_bind_text(stmt, 2, distinct_id.c_str(), -1, SQLITE_STATIC);
+      sqlite3_step(stmt);
+      sqlite3_finalize(stmt);
+    }
+  }
+  return data;
+}
+
+std::string StorageManager::GetLegacyFeatureFlags() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!db_) return "";
 
   std::string sql = "SELECT value FROM settings WHERE key = 'feature_flags'";
   sqlite3_stmt* stmt;
   if (sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
-    return "{}";
+    return "";
   }
 
-  std::string flags = "{}";
+  std::string flags;
   if (sqlite3_step(stmt) == SQLITE_ROW) {
     const char* value = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-    flags = value ? value : "{}";
+    flags = value ? value : "";
   }
 
   sqlite3_finalize(stmt);
@@ -371,6 +567,12 @@ bool StorageManager::GetOptOut() {
 }
 
 bool StorageManager::SetSessionId(const std::string& session_id) {
+  {
+    std::lock_guard<std::mutex> cache_lock(cache_mutex_);
+    session_id_cache_ = session_id;
+    session_id_cached_ = true;
+  }
+
   std::lock_guard<std::mutex> lock(mutex_);
   if (!db_) return false;
 
@@ -387,6 +589,11 @@ bool StorageManager::SetSessionId(const std::string& session_id) {
 }
 
 std::string StorageManager::GetSessionId() {
+  std::lock_guard<std::mutex> cache_lock(cache_mutex_);
+  if (session_id_cached_) {
+    return session_id_cache_;
+  }
+
   std::lock_guard<std::mutex> lock(mutex_);
   if (!db_) return "";
 
@@ -403,6 +610,8 @@ std::string StorageManager::GetSessionId() {
   }
 
   sqlite3_finalize(stmt);
+  session_id_cache_ = session_id;
+  session_id_cached_ = true;
   return session_id;
 }
 
@@ -18,7 +18,12 @@ class StorageManager {
 
   // Event queue management
   bool EnqueueEvent(const std::string& event_json);
-  std::vector<std::string> GetQueuedEvents(int max_count);
+  // All or nothing, in a single transaction: on false no row was written
+  bool EnqueueEvents(const std::vector<std::string>& events_json);
+  // Mark up to max_count unleased rows with lease_id and return them ("id|json")
+  std::vector<std::string> LeaseQueuedEvents(int max_count, const std::string& lease_id);
+  bool ReleaseLease(const std::string& lease_id);  // Make leased rows sendable again
+  bool RemoveLeasedEvents(const std::string& lease_id);  // Drop every row still under lease_id
   bool RemoveEvents(const std::vector<std::string>& event_ids);
   int GetQueueSize();
 
@@ -31,9 +36,13 @@ class StorageManager {
   bool RemoveSuperProperty(const std::string& key);
   std::map<std::string, std::string> GetAllSuperProperties();
 
-  // Feature flags cache
-  bool SetFeatureFlags(const std::string& flags_json);
-  std::string GetFeatureFlags();
+  // Feature flags cache: one opaque binary blob (see FeatureFlagsManager) per
+  // distinct_id. Only the max_entries most recently used identities are kept.
+  bool SetFeatureFlagCache(const std::string& distinct_id, const std::string& data, int max_entries);
+  std::string GetFeatureFlagCache(const std::string& distinct_id);
+  // Raw /decide/ response cached by older versions, empty if there is none.
+  // SetFeatureFlagCache() removes it.
+  std::string GetLegacyFeatureFlags();
 
   // Opt-out state
   bool SetOptOut(bool opt_out);
@@ -52,9 +61,19 @@ class StorageManager {
   std::mutex mutex_;
   std::string db_path_;
 
+  // In-memory copies of hot settings so the capture path never hits SQLite.
+  // Guarded by cache_mutex_ (not mutex_) so reads don't wait on batch writes.
+  std::mutex cache_mutex_;
+  bool distinct_id_cached_;
+  std::string distinct_id_cache_;
+  bool session_id_cached_;
+  std::string session_id_cache_;
+  bool super_properties_cached_;
+  std::map<std::string, std::string> super_properties_cache_;
+
   bool CreateTables();
   bool ExecuteSQL(const std::string& sql);
-  std::string GenerateUUID();
+  bool HasColumn(const std::string& table, const std::string& column);
 };
 
 #endif  // STORAGE_MANAGER_H_
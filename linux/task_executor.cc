@@ -0,0 +1,71 @@
+#include "task_executor.h"
+#include "posthog_logger.h"
+
+TaskExecutor::TaskExecutor(size_t thread_count) : stopping_(false) {
+  if (thread_count == 0) {
+    thread_count = 1;
+  }
+  for (size_t i = 0; i < thread_count; i++) {
+    workers_.emplace_back(&TaskExecutor::WorkerLoop, this);
+  }
+}
+
+TaskExecutor::~TaskExecutor() {
+  Shutdown();
+}
+
+bool TaskExecutor::Post(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_) {
+      return false;
+    }
+    tasks_.push_back(std::move(task));
+  }
+  cv_.notify_one();
+  return true;
+}
+
+void TaskExecutor::Shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cv_.notify_all();
+
+  for (auto& worker : workers_) {
+    if (worker.joinable()) {
+      worker.join();
+    }
+  }
+  workers_.clear();
+}
+
+size_t TaskExecutor::GetPendingCount() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return tasks_.size();
+}
+
+void TaskExecutor::WorkerLoop() {
+  for (;;) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+      if (tasks_.empty()) {
+        // Stopping and fully drained
+        return;
+      }
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+
+    try {
+      task();
+    } catch (const std::exception& e) {
+      PostHogLogger::Error("Error in background task: " + std::string(e.what()));
+    } catch (...) {
+      PostHogLogger::Error("Unknown error in background task");
+    }
+  }
+}
@@ -0,0 +1,37 @@
+#ifndef TASK_EXECUTOR_H_
+#define TASK_EXECUTOR_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small fixed-size thread pool used to keep blocking work (SQLite, network,
+// image encoding) off the GTK main loop. Tasks run in FIFO order per worker;
+// with more than one worker, tasks may run concurrently.
+class TaskExecutor {
+ public:
+  explicit TaskExecutor(size_t thread_count);
+  ~TaskExecutor();
+
+  // Queue a task. Returns false once Shutdown() has been called.
+  bool Post(std::function<void()> task);
+
+  // Run queued tasks to completion, then join all workers
+  void Shutdown();
+
+  size_t GetPendingCount();
+
+ private:
+  void WorkerLoop();
+
+  std::vector<std::thread> workers_;
+  std::deque<std::function<void()>> tasks_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stopping_;
+};
+
+#endif  // TASK_EXECUTOR_H_
@@ -0,0 +1,90 @@
+#include "image_downscaler.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+namespace {
+
+// Pushes a solid-colour source image through the downscaler. Any mix of
+// weights that sums correctly has to reproduce the colour exactly.
+std::vector<uint8_t> DownscaleSolid(int src_width, int src_height, int dst_width, int dst_height) {
+  std::vector<uint8_t> row(static_cast<size_t>(src_width) * 4);
+  for (size_t i = 0; i < row.size(); i += 4) {
+    row[i] = 200;
+    row[i + 1] = 100;
+    row[i + 2] = 50;
+    row[i + 3] = 255;
+  }
+  ImageDownscaler downscaler(src_width, src_height, dst_width, dst_height);
+  for (int y = 0; y < src_height; y++) {
+    downscaler.AddRow(row.data());
+  }
+  EXPECT_TRUE(downscaler.IsComplete());
+  return downscaler.GetOutput();
+}
+
+void ExpectSolid(const std::vector<uint8_t>& pixels, size_t expected_pixels) {
+  ASSERT_EQ(pixels.size(), expected_pixels * 4);
+  for (size_t i = 0; i < pixels.size(); i += 4) {
+    ASSERT_EQ(pixels[i], 200) << "pixel " << i / 4;
+    ASSERT_EQ(pixels[i + 1], 100) << "pixel " << i / 4;
+    ASSERT_EQ(pixels[i + 2], 50) << "pixel " << i / 4;
+    ASSERT_EQ(pixels[i + 3], 255) << "pixel " << i / 4;
+  }
+}
+
+}  // namespace
+
+TEST(ImageDownscalerTest, PreservesSolidColourAtCommonRatios) {
+  ExpectSolid(DownscaleSolid(1920, 1080, 960, 540), 960 * 540);
+  ExpectSolid(DownscaleSolid(1000, 800, 333, 267), 333 * 267);
+  ExpectSolid(DownscaleSolid(1080, 2400, 461, 1024), 461 * 1024);
+  ExpectSolid(DownscaleSolid(7, 5, 7, 5), 7 * 5);
+}
+
+// Past 256:1 some source pixels round to zero width and the last ones land
+// exactly on the far edge; they must not index one past the destination.
+TEST(ImageDownscalerTest, HandlesRatiosAbove256) {
+  ExpectSolid(DownscaleSolid(1080, 1093, 1, 1), 1);
+  ExpectSolid(DownscaleSolid(2160, 2173, 3, 3), 3 * 3);
+  ExpectSolid(DownscaleSolid(4, 3000, 1, 1), 1);
+  ExpectSolid(DownscaleSolid(3000, 4, 1, 1), 1);
+  ExpectSolid(DownscaleSolid(5000, 2, 7, 1), 7);
+}
+
+TEST(ImageDownscalerTest, SweepsRatiosAroundTheLimit) {
+  for (int src = 250; src <= 1300; src += 37) {
+    for (int dst = 1; dst <= 5; dst++) {
+      ExpectSolid(DownscaleSolid(src, 3, dst, 1), static_cast<size_t>(dst));
+      ExpectSolid(DownscaleSolid(3, src, 1, dst), static_cast<size_t>(dst));
+    }
+  }
+}
+
+TEST(ImageDownscalerTest, AveragesCoveredPixels) {
+  // Two columns, black then white, folded into one pixel
+  uint8_t row[] = {0, 0, 0, 255, 255, 255, 255, 255};
+  ImageDownscaler downscaler(2, 1, 1, 1);
+  downscaler.AddRow(row);
+  const std::vector<uint8_t>& output = downscaler.GetOutput();
+  EXPECT_EQ(output[0], 128);
+  EXPECT_EQ(output[3], 255);
+}
+
+TEST(ImageDownscalerTest, FitWithinKeepsAspectRatio) {
+  int width = 0;
+  int height = 0;
+  EXPECT_FALSE(ImageDownscaler::FitWithin(800, 600, 1024, width, height));
+  EXPECT_EQ(width, 800);
+  EXPECT_EQ(height, 600);
+
+  EXPECT_TRUE(ImageDownscaler::FitWithin(2048, 1024, 1024, width, height));
+  EXPECT_EQ(width, 1024);
+  EXPECT_EQ(height, 512);
+
+  // Very elongated sources keep at least one pixel on the short side
+  EXPECT_TRUE(ImageDownscaler::FitWithin(4, 3000, 1, width, height));
+  EXPECT_EQ(width, 1);
+  EXPECT_EQ(height, 1);
+}
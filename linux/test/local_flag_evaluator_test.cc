@@ -0,0 +1,197 @@
+#include "local_flag_evaluator.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+// Friend of LocalFlagEvaluator, so the matching helpers can be tested directly
+class LocalFlagEvaluatorTest : public ::testing::Test {
+ protected:
+  using Match = LocalFlagEvaluator::Match;
+  using PropertyFilter = LocalFlagEvaluator::PropertyFilter;
+  using ConditionGroup = LocalFlagEvaluator::ConditionGroup;
+  using FlagDefinition = LocalFlagEvaluator::FlagDefinition;
+
+  // Built the same way LoadDefinitions builds filters
+  static PropertyFilter Filter(const std::string& key, const std::string& op, const json& value,
+                               const std::string& type = "person") {
+    PropertyFilter filter;
+    filter.key = key;
+    filter.op = op;
+    filter.type = type;
+    filter.value = value;
+    if (op == "regex" || op == "not_regex") {
+      try {
+        filter.regex = std::make_shared<std::regex>(value.get<std::string>(), std::regex::ECMAScript);
+      } catch (const std::regex_error&) {
+      }
+    }
+    return filter;
+  }
+
+  static Match MatchProperty(const PropertyFilter& filter, const json& properties) {
+    return LocalFlagEvaluator::MatchProperty(filter, properties);
+  }
+
+  Match MatchCondition(const FlagDefinition& flag, const ConditionGroup& group, const std::string& distinct_id,
+                       const json& properties) const {
+    return evaluator_.MatchCondition(flag, group, distinct_id, properties);
+  }
+
+  // "true", "false" or the variant; "inconclusive" when not decidable locally
+  std::string Evaluate(const std::string& flag_key, const std::string& distinct_id,
+                       const json& properties = json::object()) const {
+    posthog::FeatureFlagValue value;
+    if (!evaluator_.Evaluate(flag_key, distinct_id, properties, &value)) {
+      return "inconclusive";
+    }
+    if (!value.enabled) {
+      return "false";
+    }
+    return value.variant.empty() ? "true" : value.variant;
+  }
+
+  LocalFlagEvaluator evaluator_;
+};
+
+// Expected values are posthog-python's _hash: the first 15 hex digits of
+// SHA1("<key>.<distinct_id><salt>") divided by 0xFFFFFFFFFFFFFFF
+TEST_F(LocalFlagEvaluatorTest, HashMatchesServerSdks) {
+  EXPECT_DOUBLE_EQ(LocalFlagEvaluator::Hash("holdout-flag", "some_distinct_id"), 0.4948250791422271);
+  EXPECT_DOUBLE_EQ(LocalFlagEvaluator::Hash("simple-flag", "distinct_id_0"), 0.7836963764220432);
+  EXPECT_DOUBLE_EQ(LocalFlagEvaluator::Hash("simple-flag", "distinct_id_1"), 0.3397069926995401);
+  EXPECT_DOUBLE_EQ(LocalFlagEvaluator::Hash("beta-feature", "user@example.com"), 0.7207482493110499);
+  EXPECT_DOUBLE_EQ(LocalFlagEvaluator::Hash("flag", ""), 0.5870601324105035);
+  EXPECT_DOUBLE_EQ(LocalFlagEvaluator::Hash("\xC3\xBCn\xC3\xAF" "code", "\xC3\xAF" "d"), 0.6602044916045645);
+  EXPECT_DOUBLE_EQ(LocalFlagEvaluator::Hash("multivariate-flag", "distinct_id_0", "variant"), 0.6186454537930379);
+  EXPECT_DOUBLE_EQ(LocalFlagEvaluator::Hash("multivariate-flag", "distinct_id_7", "variant"), 0.19476082862836147);
+}
+
+TEST_F(LocalFlagEvaluatorTest, MatchPropertyExact) {
+  json properties = {{"plan", "Pro"}, {"seats", 5}};
+  EXPECT_EQ(MatchProperty(Filter("plan", "exact", "pro"), properties), Match::kTrue);
+  EXPECT_EQ(MatchProperty(Filter("plan", "exact", json::array({"team", "PRO"})), properties), Match::kTrue);
+  EXPECT_EQ(MatchProperty(Filter("plan", "exact", "free"), properties), Match::kFalse);
+  EXPECT_EQ(MatchProperty(Filter("seats", "exact", "5"), properties), Match::kTrue);
+  EXPECT_EQ(MatchProperty(Filter("plan", "is_not", "free"), properties), Match::kTrue);
+  EXPECT_EQ(MatchProperty(Filter("plan", "is_not", json::array({"pro"})), properties), Match::kFalse);
+}
+
+TEST_F(LocalFlagEvaluatorTest, MatchPropertyStrings) {
+  json properties = {{"email", "Ben@PostHog.com"}, {"name", "abcz"}};
+  EXPECT_EQ(MatchProperty(Filter("email", "icontains", "@posthog.COM"), properties), Match::kTrue);
+  EXPECT_EQ(MatchProperty(Filter("email", "not_icontains", "@posthog.com"), properties), Match::kFalse);
+  EXPECT_EQ(MatchProperty(Filter("name", "regex", "^a.*z$"), properties), Match::kTrue);
+  EXPECT_EQ(MatchProperty(Filter("name", "not_regex", "^a.*z$"), properties), Match::kFalse);
+  // Invalid patterns never match
+  EXPECT_EQ(MatchProperty(Filter("name", "regex", "(unclosed"), properties), Match::kFalse);
+}
+
+TEST_F(LocalFlagEvaluatorTest, MatchPropertyComparisons) {
+  json properties = {{"age", 21}, {"version", "1.10"}, {"score", "42"}};
+  EXPECT_EQ(MatchProperty(Filter("age", "gte", "18"), properties), Match::kTrue);
+  EXPECT_EQ(MatchProperty(Filter("age", "gt", 21), properties), Match::kFalse);
+  EXPECT_EQ(MatchProperty(Filter("age", "lt", 30.5), properties), Match::kTrue);
+  EXPECT_EQ(MatchProperty(Filter("age", "lte", 20), properties), Match::kFalse);
+  // String values compare as strings, as on the server
+  EXPECT_EQ(MatchProperty(Filter("version", "gt", "1.9"), properties), Match::kFalse);
+  EXPECT_EQ(MatchProperty(Filter("score", "gt", "100"), properties), Match::kTrue);
+}
+
+TEST_F(LocalFlagEvaluatorTest, MatchPropertyLeavesUndecidableToTheServer) {
+  json properties = {{"plan", "pro"}, {"signup", "2024-01-01"}};
+  EXPECT_EQ(MatchProperty(Filter("missing", "exact", "x"), properties), Match::kInconclusive);
+  EXPECT_EQ(MatchProperty(Filter("plan", "is_not_set", nullptr), properties), Match::kInconclusive);
+  EXPECT_EQ(MatchProperty(Filter("plan", "is_set", nullptr), properties), Match::kTrue);
+  EXPECT_EQ(MatchProperty(Filter("id", "in", 7, "cohort"), properties), Match::kInconclusive);
+  EXPECT_EQ(MatchProperty(Filter("signup", "is_date_before", "2025-01-01"), properties), Match::kInconclusive);
+  EXPECT_EQ(MatchProperty(Filter("plan", "exact", "pro"), json()), Match::kInconclusive);
+}
+
+TEST_F(LocalFlagEvaluatorTest, MatchConditionCombinesFiltersAndRollout) {
+  FlagDefinition flag;
+  flag.key = "simple-flag";
+  json properties = {{"plan", "pro"}, {"age", 21}};
+
+  ConditionGroup everyone;
+  EXPECT_EQ(MatchCondition(flag, everyone, "distinct_id_0", properties), Match::kTrue);
+
+  ConditionGroup filtered;
+  filtered.properties = {Filter("plan", "exact", "pro"), Filter("age", "gte", 18)};
+  EXPECT_EQ(MatchCondition(flag, filtered, "distinct_id_0", properties), Match::kTrue);
+
+  filtered.properties.push_back(Filter("age", "lt", 18));
+  EXPECT_EQ(MatchCondition(flag, filtered, "distinct_id_0", properties), Match::kFalse);
+
+  ConditionGroup missing;
+  missing.properties = {Filter("email", "icontains", "@posthog.com")};
+  EXPECT_EQ(MatchCondition(flag, missing, "distinct_id_0", properties), Match::kInconclusive);
+
+  // Hashes: distinct_id_0 -> 0.78, distinct_id_1 -> 0.34
+  ConditionGroup rollout;
+  rollout.has_rollout = true;
+  rollout.rollout_percentage = 45;
+  EXPECT_EQ(MatchCondition(flag, rollout, "distinct_id_0", properties), Match::kFalse);
+  EXPECT_EQ(MatchCondition(flag, rollout, "distinct_id_1", properties), Match::kTrue);
+
+  rollout.properties = {Filter("plan", "exact", "pro")};
+  rollout.rollout_percentage = 0;
+  EXPECT_EQ(MatchCondition(flag, rollout, "distinct_id_1", properties), Match::kFalse);
+}
+
+// Same flags and expectations as posthog-python's consistency tests
+TEST_F(LocalFlagEvaluatorTest, EvaluateMatchesServerRollouts) {
+  ASSERT_TRUE(evaluator_.LoadDefinitions(R"({"flags": [
+    {"key": "simple-flag", "active": true,
+     "filters": {"groups": [{"properties": [], "rollout_percentage": 45}]}},
+    {"key": "multivariate-flag", "active": true,
+     "filters": {"groups": [{"properties": [], "rollout_percentage": 55}],
+                 "multivariate": {"variants": [
+                   {"key": "first-variant", "rollout_percentage": 50},
+                   {"key": "second-variant", "rollout_percentage": 20},
+                   {"key": "third-variant", "rollout_percentage": 20},
+                   {"key": "fourth-variant", "rollout_percentage": 5},
+                   {"key": "fifth-variant", "rollout_percentage": 5}]}}}
+  ]})"));
+
+  std::vector<std::string> simple = {"false", "true", "true", "false", "true", "false", "false",
+                                     "true", "false", "true", "false", "true", "true", "false",
+                                     "true", "false", "false", "false", "true", "true"};
+  for (size_t i = 0; i < simple.size(); i++) {
+    EXPECT_EQ(Evaluate("simple-flag", "distinct_id_" + std::to_string(i)), simple[i]) << i;
+  }
+
+  std::vector<std::string> multivariate = {"second-variant", "second-variant", "first-variant", "false",
+                                           "false", "second-variant", "first-variant", "false",
+                                           "false", "false", "first-variant", "third-variant"};
+  for (size_t i = 0; i < multivariate.size(); i++) {
+    EXPECT_EQ(Evaluate("multivariate-flag", "distinct_id_" + std::to_string(i)), multivariate[i]) << i;
+  }
+}
+
+TEST_F(LocalFlagEvaluatorTest, EvaluateFallsBackWhenNotDecidable) {
+  ASSERT_TRUE(evaluator_.LoadDefinitions(R"({"flags": [
+    {"key": "off", "active": false, "filters": {"groups": [{"properties": []}]}},
+    {"key": "group-flag", "active": true,
+     "filters": {"aggregation_group_type_index": 0, "groups": [{"properties": []}]}},
+    {"key": "continuity", "active": true, "ensure_experience_continuity": true,
+     "filters": {"groups": [{"properties": []}]}},
+    {"key": "staff", "active": true,
+     "filters": {"groups": [{"properties": [{"key": "email", "operator": "icontains",
+                                             "value": "@posthog.com", "type": "person"}]}],
+                 "payloads": {"true": {"banner": true}}}}
+  ]})"));
+
+  EXPECT_EQ(Evaluate("off", "user"), "false");
+  EXPECT_EQ(Evaluate("group-flag", "user"), "inconclusive");
+  EXPECT_EQ(Evaluate("continuity", "user"), "inconclusive");
+  EXPECT_EQ(Evaluate("unknown", "user"), "inconclusive");
+  EXPECT_EQ(Evaluate("staff", "user"), "inconclusive");
+  EXPECT_EQ(Evaluate("staff", "user", {{"email", "someone@example.com"}}), "false");
+  EXPECT_EQ(Evaluate("staff", "user", {{"email", "ben@posthog.com"}}), "true");
+
+  posthog::FeatureFlagValue value;
+  ASSERT_TRUE(evaluator_.Evaluate("staff", "user", {{"email", "ben@posthog.com"}}, &value));
+  EXPECT_EQ(value.payload_json, R"({"banner":true})");
+}
@@ -0,0 +1,59 @@
+#include "tile_differ.h"
+#include "content_hash.h"
+
+#include <algorithm>
+
+TileDiffer::TileHashes TileDiffer::HashTiles(const uint8_t* rgba, int width, int height, int stride) {
+  TileHashes result;
+  result.width = width;
+  result.height = height;
+  result.columns = (width + kTileSize - 1) / kTileSize;
+  result.rows = (height + kTileSize - 1) / kTileSize;
+  result.hashes.assign(static_cast<size_t>(result.columns) * result.rows, 0);
+
+  // Each row's hash is seeded with the running tile hash, so row order and
+  // content both feed into the result
+  for (int y = 0; y < height; y++) {
+    const uint8_t* row = rgba + static_cast<size_t>(y) * stride;
+    uint64_t* tiles = result.hashes.data() + static_cast<size_t>(y / kTileSize) * result.columns;
+    for (int column = 0; column < result.columns; column++) {
+      int x = column * kTileSize;
+      int pixels = std::min(kTileSize, width - x);
+      tiles[column] = posthog::ContentHash(row + static_cast<size_t>(x) * 4,
+                                           static_cast<size_t>(pixels) * 4, tiles[column]);
+    }
+  }
+  return result;
+}
+
+bool TileDiffer::Diff(TileHashes current, std::vector<Region>& changed) {
+  changed.clear();
+  bool comparable = !previous_.hashes.empty() && previous_.width == current.width &&
+                    previous_.height == current.height;
+
+  if (comparable) {
+    for (int row = 0; row < current.rows; row++) {
+      int y = row * kTileSize;
+      int tile_height = std::min(kTileSize, current.height - y);
+      int column = 0;
+      while (column < current.columns) {
+        size_t index = static_cast<size_t>(row) * current.columns + column;
+        if (current.hashes[index] == previous_.hashes[index]) {
+          column++;
+          continue;
+        }
+        int first = column;
+        while (column < current.columns &&
+               current.hashes[index + (column - first)] != previous_.hashes[index + (column - first)]) {
+          column++;
+        }
+        int x = first * kTileSize;
+        int run_width = std::min(column * kTileSize, current.width) - x;
+        changed.push_back({x, y, run_width, tile_height});
+      }
+    }
+  }
+
+  previous_ = std::move(current);
+  return comparable;
+}
@@ -0,0 +1,49 @@
+#ifndef TILE_DIFFER_H_
+#define TILE_DIFFER_H_
+
+#include <cstdint>
+#include <vector>
+
+// Finds which parts of an RGBA frame changed since the previous one.
+//
+// Frames are split into kTileSize x kTileSize tiles and each tile is reduced
+// to a 64-bit hash (XXH64 chained row by row), so only the previous frame's
+// hashes are kept rather than its pixels. Hashing needs no differ state and
+// can run on any thread; Diff() must see frames in capture order.
+class TileDiffer {
+ public:
+  // Multiple of the 16x16 JPEG MCU, so tile edges fall on block boundaries
+  static constexpr int kTileSize = 64;
+
+  struct TileHashes {
+    int width = 0;
+    int height = 0;
+    int columns = 0;
+    int rows = 0;
+    std::vector<uint64_t> hashes;  // Row-major, columns * rows entries
+  };
+
+  // A changed area in pixels
+  struct Region {
+    int x;
+    int y;
+    int width;
+    int height;
+  };
+
+  static TileHashes HashTiles(const uint8_t* rgba, int width, int height, int stride);
+
+  // Compare with the previous frame, then make `current` the previous one.
+  // Returns false when there is nothing comparable (first frame, size change,
+  // after Reset). Otherwise fills `changed` with the changed tiles, merged
+  // into horizontal runs so neighbouring tiles share one image.
+  bool Diff(TileHashes current, std::vector<Region>& changed);
+
+  // Forget the previous frame; the next Diff() returns false
+  void Reset() { previous_ = TileHashes(); }
+
+ private:
+  TileHashes previous_;
+};
+
+#endif  // TILE_DIFFER_H_
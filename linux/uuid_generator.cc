@@ -0,0 +1,98 @@
+#include "uuid_generator.h"
+#include <chrono>
+#include <cstdint>
+#include <random>
+
+namespace posthog {
+
+namespace {
+
+// xoshiro256** - small, fast, and plenty for identifiers (not for secrets)
+struct UuidState {
+  uint64_t s[4];
+  int64_t last_ms;
+  uint16_t counter;
+
+  UuidState() : last_ms(0), counter(0) {
+    std::random_device rd;
+    for (auto& word : s) {
+      word = (static_cast<uint64_t>(rd()) << 32) | rd();
+    }
+    // An all-zero state would only ever produce zeros
+    if ((s[0] | s[1] | s[2] | s[3]) == 0) {
+      s[0] = 0x9E3779B97F4A7C15ULL;
+    }
+  }
+
+  static uint64_t Rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+  }
+
+  uint64_t Next() {
+    const uint64_t result = Rotl(s[1] * 5, 7) * 9;
+    const uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = Rotl(s[3], 45);
+    return result;
+  }
+};
+
+thread_local UuidState uuid_state;
+
+const char kHexDigits[] = "0123456789abcdef";
+
+}  // namespace
+
+void GenerateUuid(char* out) {
+  UuidState& state = uuid_state;
+
+  int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+
+  // RFC 9562 method 1: a 12-bit counter in rand_a keeps IDs from the same
+  // millisecond ordered. A new millisecond reseeds it with a random value that
+  // leaves headroom; overflow (or a clock step backwards) borrows the next ms.
+  if (now_ms > state.last_ms) {
+    state.last_ms = now_ms;
+    state.counter = static_cast<uint16_t>(state.Next() & 0x7FF);
+  } else if (++state.counter > 0xFFF) {
+    state.last_ms++;
+    state.counter = static_cast<uint16_t>(state.Next() & 0x7FF);
+  }
+
+  uint64_t ts = static_cast<uint64_t>(state.last_ms);
+  uint64_t rand_b = state.Next();
+
+  uint8_t bytes[16];
+  for (int i = 0; i < 6; i++) {
+    bytes[i] = static_cast<uint8_t>(ts >> (40 - 8 * i));
+  }
+  bytes[6] = static_cast<uint8_t>(0x70 | ((state.counter >> 8) & 0x0F));  // version 7
+  bytes[7] = static_cast<uint8_t>(state.counter & 0xFF);
+  bytes[8] = static_cast<uint8_t>(0x80 | ((rand_b >> 56) & 0x3F));        // variant 10
+  for (int i = 9; i < 16; i++) {
+    bytes[i] = static_cast<uint8_t>(rand_b >> (8 * (15 - i)));
+  }
+
+  char* p = out;
+  for (int i = 0; i < 16; i++) {
+    if (i == 4 || i == 6 || i == 8 || i == 10) {
+      *p++ = '-';
+    }
+    *p++ = kHexDigits[bytes[i] >> 4];
+    *p++ = kHexDigits[bytes[i] & 0x0F];
+  }
+  *p = '\0';
+}
+
+std::string GenerateUuid() {
+  char buffer[kUuidStringLength + 1];
+  GenerateUuid(buffer);
+  return std::string(buffer, kUuidStringLength);
+}
+
+}  // namespace posthog
@@ -0,0 +1,23 @@
+#ifndef UUID_GENERATOR_H_
+#define UUID_GENERATOR_H_
+
+#include <string>
+
+namespace posthog {
+
+// Length of a formatted UUID (8-4-4-4-12) without the terminating NUL
+constexpr size_t kUuidStringLength = 36;
+
+// Generate an RFC 9562 UUIDv7 (48-bit Unix ms timestamp, 12-bit monotonic
+// counter, 62 random bits) into a caller-provided buffer of at least
+// kUuidStringLength + 1 bytes. The generator state is thread-local and seeded
+// once per thread, so no locks, syscalls or heap allocations on the hot path.
+// IDs generated on the same thread are strictly increasing.
+void GenerateUuid(char* out);
+
+// Convenience overload returning a std::string
+std::string GenerateUuid();
+
+}  // namespace posthog
+
+#endif  // UUID_GENERATOR_H_
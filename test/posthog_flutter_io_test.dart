@@ -0,0 +1,56 @@
+import 'package:flutter/services.dart';
+import 'package:flutter_test/flutter_test.dart';
+import 'package:posthog_flutter/src/posthog_flutter_io.dart';
+
+void main() {
+  TestWidgetsFlutterBinding.ensureInitialized();
+
+  const channel = MethodChannel('posthog_flutter');
+
+  void setHandler(Future<Object?>? Function(MethodCall call)? handler) {
+    TestDefaultBinaryMessengerBinding.instance.defaultBinaryMessenger
+        .setMockMethodCallHandler(channel, handler);
+  }
+
+  tearDown(() => setHandler(null));
+
+  group('getAllFeatureFlagsAndPayloads', () {
+    test('returns the native flags and payloads', () async {
+      setHandler((call) async {
+        expect(call.method, 'getAllFeatureFlagsAndPayloads');
+        return <String, Object?>{
+          'featureFlags': {'beta': true, 'checkout': 'variant-a'},
+          'featureFlagPayloads': {'checkout': '{"color":"blue"}'},
+        };
+      });
+
+      final result = await PosthogFlutterIO().getAllFeatureFlagsAndPayloads();
+
+      expect(result['featureFlags'], {'beta': true, 'checkout': 'variant-a'});
+      expect(result['featureFlagPayloads'], {'checkout': '{"color":"blue"}'});
+    });
+
+    test('returns an empty map when the platform does not implement it',
+        () async {
+      // The mock messenger turns this into an empty reply, which is what
+      // result.notImplemented() sends from the iOS and Android plugins
+      setHandler((call) async {
+        throw MissingPluginException();
+      });
+
+      final result = await PosthogFlutterIO().getAllFeatureFlagsAndPayloads();
+
+      expect(result, isEmpty);
+    });
+
+    test('returns an empty map when the native call fails', () async {
+      setHandler((call) async {
+        throw PlatformException(code: 'error');
+      });
+
+      final result = await PosthogFlutterIO().getAllFeatureFlagsAndPayloads();
+
+      expect(result, isEmpty);
+    });
+  });
+}